@@ -0,0 +1,58 @@
+/**
+ * @file alias.h
+ * @brief Walker/Vose alias tables for O(1) weighted sampling.
+ *
+ * A table is built once from a weight vector in O(n) time; afterwards each
+ * weighted pick costs one 32-bit random draw, a multiplication and one
+ * comparison, however many outcomes there are.
+ *
+ * @author Jakob Kastelic
+ */
+
+#ifndef ALIAS_H
+#define ALIAS_H
+
+#include <stdint.h>
+
+struct alias {
+   int n;               // number of outcomes
+   uint32_t *threshold; // keep column i if the draw fraction is below this
+   int *alias;          // outcome taken instead of column i otherwise
+};
+
+/**
+ * @brief Build an alias table for the given weights.
+ *
+ * @param a Table to initialize.
+ * @param weights Array of n non-negative weights, not all zero.
+ * @param n Number of outcomes (at least 1).
+ * @return 0 on success, -1 on error.
+ */
+int alias_init(struct alias *a, const float *weights, int n);
+
+/**
+ * @brief Free the storage of an alias table.
+ * @param a Table initialized with alias_init().
+ */
+void alias_free(struct alias *a);
+
+/**
+ * @brief Map a uniform 32-bit random number to a weighted outcome.
+ *
+ * The high part of r * n selects a column and the low part decides between
+ * the column and its alias, so a single draw suffices.
+ *
+ * @param a Alias table.
+ * @param r Uniformly distributed 32-bit random number.
+ * @return Outcome index from 0 to n - 1.
+ */
+static inline int alias_pick(const struct alias *a, uint32_t r)
+{
+   const uint64_t x = (uint64_t)r * (uint64_t)a->n;
+   const int col = (int)(x >> 32U);
+   return ((uint32_t)x < a->threshold[col]) ? col : a->alias[col];
+}
+
+#endif // ALIAS_H
+
+// end file alias.h
@@ -0,0 +1,50 @@
+/**
+ * @file arena.h
+ * @brief Bump allocator for data that is freed all at once.
+ *
+ * Allocations are carved out of large blocks by advancing a pointer, so they
+ * cost a few instructions each, lie next to each other in memory, and are
+ * released together by arena_free() instead of one at a time.
+ *
+ * @author Jakob Kastelic
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+struct arena_block;
+
+struct arena {
+   struct arena_block *head; // most recent block, linked to the older ones
+   size_t block_size;        // minimum size of a new block in bytes
+};
+
+/**
+ * @brief Prepare an empty arena; no memory is allocated until first use.
+ *
+ * @param a Arena to initialize.
+ * @param block_size Minimum block size in bytes. Sizing it to the total of
+ *        all expected allocations keeps them in a single block.
+ */
+void arena_init(struct arena *a, size_t block_size);
+
+/**
+ * @brief Allocate memory from the arena.
+ *
+ * @param a Arena.
+ * @param size Number of bytes (0 is allowed).
+ * @return Pointer aligned for any basic type, or NULL if out of memory.
+ */
+void *arena_alloc(struct arena *a, size_t size);
+
+/**
+ * @brief Free every allocation of the arena at once.
+ * @param a Arena; it is left empty and may be used again.
+ */
+void arena_free(struct arena *a);
+
+#endif // ARENA_H
+
+// end file arena.h
@@ -0,0 +1,52 @@
+/**
+ * @file cpu.h
+ * @brief Runtime selection of the instruction set of vectorized kernels.
+ *
+ * Modules with vectorized kernels (sample spans, bulk random numbers, the
+ * Levenshtein matrix) have a scalar version of each and, on x86, SSE2 and
+ * AVX2 versions. They all dispatch on the one instruction set selected here,
+ * which is the fastest the CPU supports unless changed for testing; every
+ * version gives bit-identical results.
+ *
+ * @author Jakob Kastelic
+ */
+
+#ifndef CPU_H
+#define CPU_H
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CPU_X86 1
+#define CPU_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+enum cpu_isa {
+   CPU_SCALAR, // portable C
+   CPU_SSE2,   // x86 SSE2
+   CPU_AVX2,   // x86 AVX2
+};
+
+/**
+ * @brief Check whether the CPU supports an instruction set.
+ * @param isa Instruction set to check.
+ * @return 1 if supported, 0 if not.
+ */
+int cpu_supports(enum cpu_isa isa);
+
+/**
+ * @brief Instruction set used by the vectorized kernels.
+ * @return The selected instruction set.
+ */
+enum cpu_isa cpu_isa(void);
+
+/**
+ * @brief Select the instruction set of the vectorized kernels, for testing
+ * and benchmarking. Not safe to call while other threads use the kernels.
+ *
+ * @param isa Instruction set to use.
+ * @return 0 on success, -1 if the CPU does not support it.
+ */
+int cpu_set_isa(enum cpu_isa isa);
+
+#endif // CPU_H
+
+// end file cpu.h
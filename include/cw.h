@@ -2,15 +2,29 @@
  * @file cw.h
  * @brief Generating Morse code audio.
  *
+ * All playback and rendering state lives in struct cw_data, so independent
+ * sessions, each with its own struct, may run concurrently in any number of
+ * threads.
+ *
  * @author Jakob Kastelic
  */
 
 #ifndef CW_H
 #define CW_H
 
+#include <stddef.h>
+
+struct cw_player; // playback in progress, private to cw.c
+
+struct morse_enc {
+   const char *in;   // next input character
+   const char *code; // remaining dots and dashes of the current character
+   int first_char;   // nonzero until a character of the word is sent
+};
+
 struct cw_data {
-   const char *morse; // pointer to expanded Morse code string
-   int pos;           // current character position in Morse string
+   struct morse_enc enc; // incremental Morse encoder for the input text
+   char sym;             // next Morse symbol to play, or '\0' at the end
 
    int tone_samples; // number of samples left in current tone
    int tone_len;     // duration of current tone in samples
@@ -20,15 +34,35 @@ struct cw_data {
    int intra_gap; // duration of intra-character gap in samples
    int inter_gap; // duration of inter-character/word gap in samples
 
-   float freq;       // tone frequency in Hz
-   float amp;        // tone amplitude from 0 to 1
-   int delay_frames; // initial delay, in frames
+   float freq;         // tone frequency in Hz
+   float amp;          // tone amplitude from 0 to 1
+   long delay_samples; // initial delay left to play, in samples
 
    float delay_sec; // initial delay, in seconds
    float speed1;    // Farnsworth speed 1 (WPM)
    float speed2;    // Farnsworth speed 2 (WPM)
 
+   // audio format: zero fields are overwritten with their defaults when a
+   // session starts, so the values in use can be read back
+   int sample_rate;     // output sample rate in Hz, 0 for 48000
+   int channels;        // output channels (1 to 8), 0 for 2
+   int period_frames;   // device period size in frames, 0 for 64
+   int periods;         // number of device periods, 0 for 1
+   const char *backend; // miniaudio backend name, e.g. "alsa", or NULL
+   float latency_ms;    // device buffering latency, set by cw_play_start()
+
    unsigned long long total_samples; // total number of samples played
+
+   float *dit_wave;   // pre-rendered dit, interleaved frames
+   float *dah_wave;   // pre-rendered dah, interleaved frames
+   const float *wave; // element currently being played
+
+   struct cw_player *player; // set between cw_play_start() and cw_play_wait()
+};
+
+struct cw_voice {
+   const char *text;  // text sent by this station
+   struct cw_data cw; // its tone, speeds and start offset (delay_sec)
 };
 
 /**
@@ -44,6 +78,26 @@ struct cw_data {
  */
 void ascii_to_morse_expanded(const char *in, char *out);
 
+/**
+ * @brief Start incremental Morse encoding of an ASCII string.
+ *
+ * The encoder yields the same symbols as ascii_to_morse_expanded(), one at a
+ * time, without an intermediate buffer. The input string must remain valid
+ * while the encoder is in use.
+ *
+ * @param[out] enc Encoder state to initialize.
+ * @param[in] in Null-terminated ASCII input string.
+ */
+void morse_enc_init(struct morse_enc *enc, const char *in);
+
+/**
+ * @brief Return the next expanded Morse code symbol.
+ *
+ * @param enc Encoder state, initialized with morse_enc_init().
+ * @return One of '.', '-', '|', '/', or '\0' once the input is exhausted.
+ */
+char morse_enc_next(struct morse_enc *enc);
+
 /**
  * @brief Count total Morse code time units in an expanded Morse code string.
  *
@@ -73,11 +127,131 @@ int count_units(const char *morse);
  *           - delay_sec: Initial delay in seconds.
  *           - speed1: Character speed in words per minute (WPM).
  *           - speed2: Farnsworth speed in WPM (<= speed1).
- *           - morse: (will be set internally)
+ *           - sample_rate, channels: Output format, or 0 for 48 kHz stereo.
+ *           - period_frames, periods: Device buffering, or 0 for a single
+ *             period of 64 frames. Larger values add latency but make
+ *             underruns less likely.
+ *           - backend: Name of the miniaudio backend to use (for example
+ *             "alsa", "pulseaudio" or "null"), or NULL to try them all.
+ *           Zero audio parameters are replaced by their defaults in cw
+ *           itself, and the remaining fields are set internally, so cw is
+ *           modified even when the call fails after validation.
  * @return Total playback duration in milliseconds, or -1 on error.
  */
 int cw_play(const char *str, struct cw_data *cw);
 
+/**
+ * @brief Start playing a Morse code string in the background.
+ *
+ * Opens the audio device and returns as soon as playback has started, so the
+ * caller can do other work meanwhile. Every successful call must be paired
+ * with cw_play_wait(), and cw must stay valid and untouched until then. On
+ * success, cw->latency_ms holds the buffering latency the backend actually
+ * granted, which may differ from the requested period_frames and periods.
+ *
+ * @param str Null-terminated input string to transmit (ASCII). It must stay
+ *            valid until cw_play_wait() returns.
+ * @param cw Pointer to a configured cw_data struct, as for cw_play().
+ * @return 0 on success, -1 on error.
+ */
+int cw_play_start(const char *str, struct cw_data *cw);
+
+/**
+ * @brief Wait until playback started by cw_play_start() has finished.
+ *
+ * Blocks on a completion event signalled by the audio callback once the last
+ * gap has been played, then closes the audio device.
+ *
+ * @param cw The cw_data struct given to cw_play_start(), or that of the first
+ *           voice given to cw_mix_play_start().
+ * @return Total playback duration in milliseconds, or -1 on error.
+ */
+int cw_play_wait(struct cw_data *cw);
+
+/**
+ * @brief Render a Morse code string to memory without an audio device.
+ *
+ * Runs the same synthesis as cw_play() as fast as possible, producing
+ * interleaved float frames at the configured sample rate and channel count,
+ * starting with delay_sec of silence. At most max_frames frames are written;
+ * pass buf = NULL to only query the length.
+ *
+ * @param str Null-terminated input string to transmit (ASCII).
+ * @param cw Pointer to a configured cw_data struct, as for cw_play().
+ * @param buf Output buffer of at least channels * max_frames floats, or NULL.
+ * @param max_frames Capacity of buf in frames.
+ * @return Total number of frames in the rendering, or -1 on error.
+ */
+long cw_render(const char *str, struct cw_data *cw, float *buf,
+               size_t max_frames);
+
+/**
+ * @brief Render a Morse code string to a 16-bit PCM WAV file.
+ *
+ * Like cw_render(), but streams the audio to the file in fixed-size chunks,
+ * so memory use does not depend on the length of the text.
+ *
+ * @param str Null-terminated input string to transmit (ASCII).
+ * @param cw Pointer to a configured cw_data struct, as for cw_play().
+ * @param path Path of the WAV file to create.
+ * @return Total duration in milliseconds, or -1 on error.
+ */
+int cw_render_wav(const char *str, struct cw_data *cw, const char *path);
+
+/**
+ * @brief Mix several independent Morse streams into one buffer.
+ *
+ * Every voice is rendered as by cw_render(), with its own text, tone, speeds
+ * and amplitude, starting after its delay_sec, and the voices are summed, for
+ * example to simulate a pile-up or interfering stations. The mix lasts until
+ * the longest voice has finished. The sum is not clipped; choose amplitudes
+ * that add up to at most 1 to avoid overload. All voices must have the same
+ * sample rate and channel count.
+ *
+ * @param voices Array of voices with configured cw_data.
+ * @param num Number of voices (at least 1).
+ * @param buf Output buffer of at least channels * max_frames floats, or NULL.
+ * @param max_frames Capacity of buf in frames.
+ * @return Total number of frames in the mix, or -1 on error.
+ */
+long cw_mix(struct cw_voice *voices, int num, float *buf, size_t max_frames);
+
+/**
+ * @brief Mix several Morse streams, as cw_mix(), into a 16-bit PCM WAV file.
+ *
+ * @param voices Array of voices with configured cw_data.
+ * @param num Number of voices (at least 1).
+ * @param path Path of the WAV file to create.
+ * @return Total duration in milliseconds, or -1 on error.
+ */
+int cw_mix_wav(struct cw_voice *voices, int num, const char *path);
+
+/**
+ * @brief Start playing a mix of several Morse streams, as cw_mix(), in the
+ * background.
+ *
+ * The mix is rendered ahead by the same worker thread and ring buffer as
+ * cw_play_start(), one block of all voices at a time, so any number of
+ * stations is played by a single audio device. The device is configured from
+ * the first voice, whose latency_ms is set on success. Every successful call
+ * must be paired with cw_play_wait() on the cw_data of the first voice, and
+ * the voices and their texts must stay valid and untouched until then.
+ *
+ * @param voices Array of voices with configured cw_data.
+ * @param num Number of voices (at least 1).
+ * @return 0 on success, -1 on error.
+ */
+int cw_mix_play_start(struct cw_voice *voices, int num);
+
+/**
+ * @brief Play a mix of several Morse streams and wait until it has finished.
+ *
+ * @param voices Array of voices with configured cw_data.
+ * @param num Number of voices (at least 1).
+ * @return Total playback duration in milliseconds, or -1 on error.
+ */
+int cw_mix_play(struct cw_voice *voices, int num);
+
 /**
  * @brief Compute the CW transmission duration in seconds.
  *
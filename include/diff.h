@@ -10,6 +10,38 @@
 
 #include "record.h"
 #include <stddef.h>
+#include <stdint.h>
+
+enum diff_mode {
+   DIFF_AUTO,        // choose by input size, see lev_diff_mode()
+   DIFF_FULL,        // keep the whole (len1+1) x (len2+1) matrix
+   DIFF_HIRSCHBERG,  // divide and conquer in memory linear in the shorter
+                     // string, times the log of the longer one
+   DIFF_BITPARALLEL, // bit-parallel distance, then only the band of the
+                     // matrix that alignments of that cost can reach
+   DIFF_BANDED,      // band around the diagonal, doubled until proven
+};
+
+struct diff_ctx {
+   int *dp;          // DP matrix, one contiguous block reused between calls
+   size_t cap;       // capacity of dp in cells
+   uint64_t *bits;   // bit vectors of the bit-parallel distance
+   size_t bits_cap;  // capacity of bits in words
+   int16_t *dp16;    // anti-diagonals of the vectorized DIFF_FULL
+   size_t cap16;     // capacity of dp16 in cells
+};
+
+/**
+ * @brief Prepare an empty context; memory is allocated on first use.
+ * @param ctx Context to initialize.
+ */
+void diff_ctx_init(struct diff_ctx *ctx);
+
+/**
+ * @brief Free the scratch memory of a context.
+ * @param ctx Context initialized with diff_ctx_init().
+ */
+void diff_ctx_free(struct diff_ctx *ctx);
 
 /**
  * @brief Computes the Levenshtein distance between two strings and records
@@ -38,6 +70,76 @@
  */
 int lev_diff(struct record *r, const char *s1, const char *s2);
 
+/**
+ * @brief Computes the Levenshtein distance as lev_diff(), using the scratch
+ * memory of a context.
+ *
+ * The DP matrix is kept in the context as one contiguous block, which only
+ * grows when a longer pair of strings is compared, so repeated calls are
+ * free of allocations after the first.
+ *
+ * @param ctx Context initialized with diff_ctx_init().
+ * @param r Pointer to the record, into which the weights will be recorded.
+ * @param s1 A pointer to the first null-terminated input string.
+ * @param s2 A pointer to the second null-terminated input string.
+ * @return The Levenshtein distance between `s1` and `s2`, or -1 on error.
+ */
+int lev_diff_ctx(struct diff_ctx *ctx, struct record *r, const char *s1,
+                 const char *s2);
+
+/**
+ * @brief Computes the Levenshtein distance as lev_diff_ctx(), with a choice
+ * of algorithm.
+ *
+ * DIFF_HIRSCHBERG never holds the whole matrix. It splits the rows in half,
+ * computes ahead to the middle row, traces the lower half of the alignment
+ * from there and then recurses into the upper half, keeping one saved row
+ * per level. Rows run along the shorter string. Because the traceback is
+ * replayed rather than re-derived, every mode records exactly the same
+ * weights as DIFF_FULL; the price is a factor of about log2(len / 32) in
+ * time.
+ *
+ * DIFF_BITPARALLEL first finds the distance d with Myers' bit-vector
+ * algorithm, 64 cells per word operation. An alignment of cost d stays
+ * within about d / 2 diagonals of the corner-to-corner one, so only that
+ * band of the matrix is filled and traced, in O(len * d) time and memory.
+ *
+ * DIFF_BANDED needs no distance up front. It fills a band t diagonals
+ * either side of the corner-to-corner ones, starting from t = len / 16 as
+ * suits transcripts near the target accuracy, and doubles t until the cost
+ * found is below that of any path leaving the band. Time and memory are
+ * O(len * d) for distance d.
+ *
+ * DIFF_FULL fills the matrix one anti-diagonal at a time, whose cells are
+ * independent of each other, in 16-bit lanes of SSE2 or AVX2 registers (8
+ * or 16 cells per operation) where the CPU has them and len1 + len2 < 32767,
+ * and row by row otherwise; see cpu_set_isa().
+ *
+ * DIFF_AUTO fills matrices of up to 4096 cells outright. Above that it uses
+ * DIFF_BANDED while the band fits in 4M cells (16 MB), and DIFF_HIRSCHBERG
+ * once it would not.
+ *
+ * @param ctx Context initialized with diff_ctx_init().
+ * @param r Pointer to the record, into which the weights will be recorded.
+ * @param s1 A pointer to the first null-terminated input string.
+ * @param s2 A pointer to the second null-terminated input string.
+ * @param mode Algorithm to use.
+ * @return The Levenshtein distance between `s1` and `s2`, or -1 on error.
+ */
+int lev_diff_mode(struct diff_ctx *ctx, struct record *r, const char *s1,
+                  const char *s2, enum diff_mode mode);
+
+/**
+ * @brief Computes only the Levenshtein distance, with the bit-parallel
+ * algorithm of DIFF_BITPARALLEL.
+ *
+ * @param ctx Context initialized with diff_ctx_init().
+ * @param s1 A pointer to the first null-terminated input string.
+ * @param s2 A pointer to the second null-terminated input string.
+ * @return The Levenshtein distance between `s1` and `s2`, or -1 on error.
+ */
+int lev_distance(struct diff_ctx *ctx, const char *s1, const char *s2);
+
 #endif /* LEV_DIFF_H */
 
 // end file diff.h
@@ -8,16 +8,75 @@
 #ifndef GEN_CHARS_H
 #define GEN_CHARS_H
 
+#include "alias.h"
+#include "arena.h"
+#include "rng.h"
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 
 #define GEN_MAX 100000
+#define MARKOV_MAX_ORDER 4
 
 struct WordEntry {
    char *word;
    float weight;
 };
 
+// a loaded word file, kept by the dictionary that points into it
+struct word_map {
+   const char *map;           // read-only mapping of the word file, or NULL
+   size_t size;               // length of the mapping in bytes
+   struct WordEntry *entries; // words of a file read as a stream, or NULL
+   int count;                 // number of entries
+};
+
+struct word_dict {
+   const char **words;  // start of every word; not null-terminated, see lens
+   size_t *lens;        // length of every word
+   float *weights;      // weight of every word
+   int count;           // number of words
+   float total_weight;  // sum of the weights
+   struct arena arena;  // one block holding the arrays (and copied words)
+   struct word_map src; // file loaded by word_dict_load(), if any
+};
+
+struct word_sampler {
+   const char *const *words; // word of every entry
+   const size_t *lens;       // length of every word
+   int count;                // number of entries
+   struct alias table;       // weighted choice of an entry
+   int owned;                // words and lens allocated, not borrowed
+};
+
+struct markov {
+   int order;            // characters of context
+   uint32_t span;        // number of possible contexts
+   int states;           // number of contexts seen in training
+   int *first;           // transitions of state s: first[s] to first[s + 1] - 1
+   uint32_t *end;        // chance of ending the word in each state, of 2^32
+   unsigned char *sym;   // next character of every transition
+   uint32_t *threshold;  // alias tables of all states, back to back
+   int *alias;           // (see struct alias)
+   uint32_t *keys;       // context of every hash slot plus one, or NULL
+   int *index;           // state of every context, or of every hash slot
+   size_t mask;          // number of hash slots minus one
+   struct alias unigram; // fallback for contexts without a continuation
+   struct arena arena;   // storage of all the arrays above
+};
+
+/**
+ * @brief Receives generated text from gen_stream(), one chunk at a time.
+ * @return 0 to continue, nonzero to abort generation.
+ */
+typedef int (*gen_sink)(void *ctx, const char *buf, size_t len);
+
+struct gen_sampler {
+   char *charset;      // characters to draw from
+   int len;            // number of characters in charset
+   struct alias table; // weighted choice of a charset index
+};
+
 /**
  * @brief generate a random string of space-separated words with weights
  *
@@ -25,13 +84,122 @@ struct WordEntry {
  * @param num_char total number of characters to generate (excluding null)
  * @param min_word minimum length of each word (>=1)
  * @param max_word maximum length of each word (>=min_word)
- * @param weights array of at most NUM_WEIGHTS floats weights
+ * @param weights array of at most MAX_CHARSET_LEN float weights
  * @param charset string of characters to draw from, or NULL for default
+ * @param rng random number generator, or NULL for rng_default()
  *
  * @return 0 on success, -1 on error
  */
 int gen_chars(char *s, const size_t num_char, const int min_word,
-              const int max_word, const float *weights, const char *charset);
+              const int max_word, const float *weights, const char *charset,
+              struct rng *rng);
+
+/**
+ * @brief Prepare weighted character sampling for repeated gen_chars_sampler()
+ * calls.
+ *
+ * The weights are looked up for each charset character and turned into an
+ * alias table once, so that every generated character then costs O(1).
+ *
+ * @param gs sampler to initialize; free with gen_sampler_free()
+ * @param weights array of at most MAX_CHARSET_LEN float weights, or NULL for
+ * uniform weights
+ * @param charset string of characters to draw from, or NULL for default
+ *
+ * @return 0 on success, -1 on error
+ */
+int gen_sampler_init(struct gen_sampler *gs, const float *weights,
+                     const char *charset);
+
+/**
+ * @brief Free a sampler prepared by gen_sampler_init().
+ * @param gs sampler to free
+ */
+void gen_sampler_free(struct gen_sampler *gs);
+
+/**
+ * @brief generate a random string of space-separated words, as gen_chars(),
+ * drawing characters from a prepared sampler
+ *
+ * @param s output buffer (must be large enough)
+ * @param num_char total number of characters to generate (excluding null)
+ * @param min_word minimum length of each word (>=1)
+ * @param max_word maximum length of each word (>=min_word)
+ * @param gs sampler prepared with gen_sampler_init()
+ * @param rng random number generator, or NULL for rng_default(); the random
+ * numbers are generated in bulk from RNG_LANES streams split off it anew on
+ * every call, see rng_lanes_init()
+ *
+ * @return 0 on success, -1 on error
+ */
+int gen_chars_sampler(char *s, const size_t num_char, const int min_word,
+                      const int max_word, const struct gen_sampler *gs,
+                      struct rng *rng);
+
+/**
+ * @brief Generate random words of unlimited length in constant memory.
+ *
+ * Unlike gen_chars(), there is no GEN_MAX limit and the text is never held in
+ * memory as a whole. It is produced in chunks of whole words of 64 KiB, or
+ * of what remains for the last ones, plus at most max_word + 1 characters,
+ * and each chunk is passed to the sink as soon as it is its turn. Every chunk
+ * is drawn from its own random stream, a long jump apart from the others, so
+ * a pool of worker threads generates chunks ahead, up to two per thread,
+ * while the calling thread passes the finished ones to the sink in order.
+ * The text depends only on the state of rng, not on the number of threads.
+ * Exactly num_char characters of space-separated words are emitted; the last
+ * word may be cut short.
+ *
+ * @param sink function receiving each chunk; a nonzero return aborts
+ * @param ctx passed through to the sink
+ * @param num_char total number of characters to generate
+ * @param min_word minimum length of each word (>=1)
+ * @param max_word maximum length of each word (>=min_word)
+ * @param weights array of at most MAX_CHARSET_LEN float weights, or NULL for
+ * uniform weights
+ * @param charset string of characters to draw from, or NULL for default
+ * @param threads number of worker threads, or 0 for one per online CPU
+ * @param rng random number generator, or NULL for rng_default(); it is
+ * advanced by one long jump per chunk
+ *
+ * @return 0 on success, -1 on error
+ */
+int gen_stream(gen_sink sink, void *ctx, const size_t num_char,
+               const int min_word, const int max_word, const float *weights,
+               const char *charset, int threads, struct rng *rng);
+
+/**
+ * @brief Sink for gen_stream() that writes the chunks to a stream.
+ *
+ * @param ctx FILE pointer to write to
+ * @param buf characters to write
+ * @param len number of characters
+ *
+ * @return 0 on success, -1 on error
+ */
+int gen_sink_file(void *ctx, const char *buf, size_t len);
+
+/**
+ * @brief Generate a large corpus of random words in parallel, as
+ * gen_stream(), into a file.
+ *
+ * Exactly num_char characters are written, followed by a newline.
+ *
+ * @param out_file path of output file, or NULL for stdout
+ * @param num_char total number of characters to generate (excluding newline)
+ * @param min_word minimum length of each word (>=1)
+ * @param max_word maximum length of each word (>=min_word)
+ * @param weights array of at most MAX_CHARSET_LEN float weights, or NULL for
+ * uniform weights
+ * @param charset string of characters to draw from, or NULL for default
+ * @param threads number of worker threads, or 0 for one per online CPU
+ * @param rng random number generator, or NULL for rng_default()
+ *
+ * @return 0 on success, -1 on error
+ */
+int gen_corpus(const char *out_file, const size_t num_char, const int min_word,
+               const int max_word, const float *weights, const char *charset,
+               int threads, struct rng *rng);
 
 /**
  * @brief Generate a sequence of pseudorandom words and write them to an output
@@ -56,11 +224,12 @@ int gen_chars(char *s, const size_t num_char, const int min_word,
  * input.
  * @param nw Number of random words to generate.
  * @param nl Number of lines (words) to read from the word file.
+ * @param rng Random number generator, or NULL for rng_default().
  *
  * @return 0 on success, -1 on failure.
  */
 int gen_words(const char *out_file, const char *word_file, const int nw,
-              const int nl);
+              const int nl, struct rng *rng);
 
 /**********************************************
  * HELPER FUNCTIONS
@@ -97,13 +266,17 @@ float compute_total_weight(struct WordEntry *entries, int count);
 /**
  * @brief Select a word randomly based on weights.
  *
+ * Scans the whole list on every call; for repeated draws, build an index with
+ * word_sampler_init() instead.
+ *
  * @param entries Array of WordEntry.
  * @param count Number of entries.
  * @param total_weight Total weight of all entries.
+ * @param rng Random number generator, or NULL for rng_default().
  * @return Pointer to selected word.
  */
 const char *select_random_word(struct WordEntry *entries, int count,
-                               float total_weight);
+                               float total_weight, struct rng *rng);
 
 /**
  * @brief Write randomly selected words to the given output.
@@ -113,10 +286,77 @@ const char *select_random_word(struct WordEntry *entries, int count,
  * @param count Number of entries.
  * @param nw Number of words to generate.
  * @param total_weight Total weight of all entries.
+ * @param rng Random number generator, or NULL for rng_default().
  * @return 0 on success, -1 on error.
  */
 int write_words(FILE *out, struct WordEntry *entries, int count, int nw,
-                float total_weight);
+                float total_weight, struct rng *rng);
+
+/**
+ * @brief Build a sampling index over a word list.
+ *
+ * Draws from the index follow the same distribution as select_random_word(),
+ * but each costs O(1) instead of a scan of the whole list. The entries must
+ * stay valid while the index is in use.
+ *
+ * @param ws Index to initialize; free with word_sampler_free().
+ * @param entries Array of WordEntry with non-negative weights.
+ * @param count Number of entries (at least 1).
+ * @param total_weight Total weight of all entries; if not positive, words are
+ * selected uniformly.
+ * @return 0 on success, -1 on error.
+ */
+int word_sampler_init(struct word_sampler *ws, const struct WordEntry *entries,
+                      int count, float total_weight);
+
+/**
+ * @brief Build a sampling index over a packed dictionary.
+ *
+ * As word_sampler_init(), but the index uses the word and length arrays of
+ * the dictionary directly, so the dictionary must outlive the index.
+ *
+ * @param ws Index to initialize; free with word_sampler_free().
+ * @param wd Dictionary with at least one word.
+ * @return 0 on success, -1 on error.
+ */
+int word_sampler_init_dict(struct word_sampler *ws, const struct word_dict *wd);
+
+/**
+ * @brief Free an index built by word_sampler_init().
+ * @param ws Index to free.
+ */
+void word_sampler_free(struct word_sampler *ws);
+
+/**
+ * @brief Select a random word from an index.
+ *
+ * Words of a dictionary loaded by word_dict_load() are views into the word
+ * file and are not null-terminated; use the length.
+ *
+ * @param ws Index built by word_sampler_init() or word_sampler_init_dict().
+ * @param rng Random number generator, or NULL for rng_default().
+ * @param len Receives the length of the word, unless NULL.
+ * @return Pointer to selected word.
+ */
+const char *word_sampler_pick(const struct word_sampler *ws, struct rng *rng,
+                              size_t *len);
+
+/**
+ * @brief Write randomly selected words, as write_words(), using a prebuilt
+ * index.
+ *
+ * The words are assembled in a large block buffer that is written out with
+ * single fwrite() calls, and the random numbers are generated in bulk.
+ *
+ * @param out Output file pointer.
+ * @param ws Index built by word_sampler_init().
+ * @param nw Number of words to generate.
+ * @param rng Random number generator, or NULL for rng_default(); lanes are
+ * split off it on every call, as for gen_chars_sampler().
+ * @return 0 on success, -1 on error.
+ */
+int write_words_sampler(FILE *out, const struct word_sampler *ws, int nw,
+                        struct rng *rng);
 
 /**
  * @brief Checks if the read line is too long to fit in the buffer.
@@ -171,6 +411,104 @@ int parse_line(const char *line, char **word_out, float *weight_out,
 int parse_word_file(const char *word_file, struct WordEntry **entries_out,
                     int nl);
 
+/**
+ * @brief Pack a word list into a dictionary.
+ *
+ * The words, their lengths and their weights are copied into one contiguous
+ * arena block in struct-of-arrays layout, and are freed together by
+ * word_dict_free().
+ *
+ * @param wd Dictionary to initialize.
+ * @param entries Array of WordEntry.
+ * @param count Number of entries.
+ * @return 0 on success, -1 on error.
+ */
+int word_dict_init(struct word_dict *wd, const struct WordEntry *entries,
+                   int count);
+
+/**
+ * @brief Load a word file into a dictionary without copying the words.
+ *
+ * Accepts the same format as parse_word_file(). The file is mapped
+ * read-only and kept by the dictionary until word_dict_free(); the words are
+ * views into the mapping, given by their start and length, and are not
+ * null-terminated. Standard input, pipes, FIFOs and empty files cannot be
+ * mapped and are parsed as a stream instead.
+ *
+ * @param wd Dictionary to initialize.
+ * @param word_file Path to input file. If NULL, will read from standard input.
+ * @param nl Number of lines to read (all if not positive)
+ * @return Number of words read on success, -1 on failure.
+ */
+int word_dict_load(struct word_dict *wd, const char *word_file, int nl);
+
+/**
+ * @brief Free a dictionary in one step.
+ * @param wd Dictionary initialized by word_dict_init() or word_dict_load().
+ */
+void word_dict_free(struct word_dict *wd);
+
+/**
+ * @brief Train a character-level Markov model on a dictionary.
+ *
+ * Every word contributes its character n-grams, counted with the word's
+ * weight (or once, if the dictionary has no weights). For each context of
+ * the last `order` characters, the model keeps the chance of ending the word
+ * there and an alias table over the characters that follow it. Contexts are
+ * indexed directly for order 1 and 2, and through a hash table above that.
+ *
+ * @param m Model to initialize; free with markov_free().
+ * @param order Number of characters of context, from 1 to MARKOV_MAX_ORDER.
+ * @param wd Dictionary to train on.
+ * @param weights Array of MAX_CHARSET_LEN per-character weights that scale
+ * every transition into the character, or NULL for none.
+ * @return 0 on success, -1 on error.
+ */
+int markov_train(struct markov *m, int order, const struct word_dict *wd,
+                 const float *weights);
+
+/**
+ * @brief Train a character-level Markov model on free text.
+ *
+ * As markov_train(), but the words are the runs of supported characters in
+ * the text (after conversion to lowercase), each counted once.
+ *
+ * @param m Model to initialize; free with markov_free().
+ * @param order Number of characters of context, from 1 to MARKOV_MAX_ORDER.
+ * @param text Null-terminated training text.
+ * @param weights Per-character weights as for markov_train(), or NULL.
+ * @return 0 on success, -1 on error.
+ */
+int markov_train_text(struct markov *m, int order, const char *text,
+                      const float *weights);
+
+/**
+ * @brief Free a model built by markov_train() or markov_train_text().
+ * @param m Model to free.
+ */
+void markov_free(struct markov *m);
+
+/**
+ * @brief Generate space-separated pseudo-words from a Markov model.
+ *
+ * Each word is a walk through the model from the start of a word until it
+ * draws the end of the word, or reaches max_word characters. Below min_word
+ * characters the walk never ends. Contexts that were not seen in training
+ * fall back to the overall character frequencies.
+ *
+ * @param m Trained model.
+ * @param s Output buffer of at least num_char bytes.
+ * @param num_char Buffer size; at most num_char - 1 characters are written,
+ * followed by a null; the last word may be cut short.
+ * @param min_word Minimum length of each word (>=1).
+ * @param max_word Maximum length of each word (>=min_word).
+ * @param rng Random number generator, or NULL for rng_default(); lanes are
+ * split off it on every call, as for gen_chars_sampler().
+ * @return 0 on success, -1 on error.
+ */
+int markov_gen(const struct markov *m, char *s, const size_t num_char,
+               const int min_word, const int max_word, struct rng *rng);
+
 #endif // GEN_CHARS_H
 
 // end file gen.h
@@ -0,0 +1,76 @@
+/**
+ * @file ring.h
+ * @brief Lock-free single-producer/single-consumer ring buffer of samples.
+ *
+ * One thread may write and one other thread may read concurrently without
+ * locks; the two sides synchronize only through the C11 atomic read and write
+ * counters.
+ *
+ * @author Jakob Kastelic
+ */
+
+#ifndef RING_H
+#define RING_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+struct ring {
+   float *buf;         // sample storage
+   size_t size;        // capacity in samples, a power of two
+   atomic_size_t head; // total samples written, advanced by the producer
+   atomic_size_t tail; // total samples read, advanced by the consumer
+};
+
+/**
+ * @brief Allocate an empty ring buffer.
+ *
+ * @param r Ring buffer to initialize.
+ * @param size Minimum capacity in samples; rounded up to a power of two.
+ * @return 0 on success, -1 on error.
+ */
+int ring_init(struct ring *r, size_t size);
+
+/**
+ * @brief Free the storage of a ring buffer.
+ * @param r Ring buffer initialized with ring_init().
+ */
+void ring_free(struct ring *r);
+
+/**
+ * @brief Number of samples the consumer can read right now.
+ * @param r Ring buffer.
+ * @return Readable samples.
+ */
+size_t ring_readable(struct ring *r);
+
+/**
+ * @brief Number of samples the producer can write right now.
+ * @param r Ring buffer.
+ * @return Writable samples.
+ */
+size_t ring_writable(struct ring *r);
+
+/**
+ * @brief Append samples to the ring buffer (producer side).
+ *
+ * @param r Ring buffer.
+ * @param src Samples to write.
+ * @param n Number of samples in src.
+ * @return Number of samples written, less than n if the buffer is full.
+ */
+size_t ring_write(struct ring *r, const float *src, size_t n);
+
+/**
+ * @brief Remove samples from the ring buffer (consumer side).
+ *
+ * @param r Ring buffer.
+ * @param dst Destination for the samples.
+ * @param n Maximum number of samples to read.
+ * @return Number of samples read, less than n if the buffer ran empty.
+ */
+size_t ring_read(struct ring *r, float *dst, size_t n);
+
+#endif // RING_H
+
+// end file ring.h
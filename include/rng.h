@@ -0,0 +1,182 @@
+/**
+ * @file rng.h
+ * @brief xoshiro128** pseudorandom number generator with explicit state.
+ *
+ * All state lives in struct rng, so each thread may own a generator, and a
+ * generator seeded with the same value always yields the same sequence.
+ * Independent streams for parallel work are split off with rng_split(); each
+ * is 2^64 draws long and does not overlap the others. Not cryptographically
+ * secure.
+ *
+ * @author Jakob Kastelic
+ */
+
+#ifndef RNG_H
+#define RNG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define RNG_LANES 8
+
+struct rng {
+   uint32_t s[4]; // generator state, never all zero
+};
+
+struct rng_lanes {
+   uint32_t s[4][RNG_LANES]; // state word k of every lane
+};
+
+/**
+ * @brief Seed a generator.
+ *
+ * The 64-bit seed is expanded into the full state with splitmix64, so nearby
+ * seeds give unrelated sequences.
+ *
+ * @param r Generator to seed.
+ * @param seed Any value, including zero.
+ */
+void rng_seed(struct rng *r, uint64_t seed);
+
+/**
+ * @brief Advance a generator by 2^64 draws.
+ * @param r Generator.
+ */
+void rng_jump(struct rng *r);
+
+/**
+ * @brief Advance a generator by 2^96 draws.
+ *
+ * Streams a long jump apart can each be split into 2^32 streams with
+ * rng_split() without overlapping, for two levels of parallelism.
+ *
+ * @param r Generator.
+ */
+void rng_long_jump(struct rng *r);
+
+/**
+ * @brief Split off an independent stream.
+ *
+ * The child takes over the next 2^64 draws of r, and r jumps past them, so
+ * repeated calls hand out non-overlapping streams in a reproducible order.
+ *
+ * @param r Parent generator, advanced by 2^64 draws.
+ * @param child Generator receiving the stream.
+ */
+void rng_split(struct rng *r, struct rng *child);
+
+/**
+ * @brief Process-wide generator, seeded from the time on first use.
+ *
+ * Used wherever a NULL generator is passed. It is not safe to use from more
+ * than one thread at a time; give each thread its own generator instead.
+ *
+ * @return Pointer to the default generator.
+ */
+struct rng *rng_default(void);
+
+/**
+ * @brief Set up a multi-lane generator for bulk generation.
+ *
+ * Each of the RNG_LANES lanes is an independent xoshiro128** stream split off
+ * r with rng_split(), and all lanes are advanced together with SIMD
+ * instructions where available. The output depends only on the seed of r,
+ * not on the instruction set used.
+ *
+ * Splitting costs RNG_LANES jumps of r, a few hundred steps each, so it pays
+ * off for bulk draws rather than a handful of values. Because r then skips
+ * past all the lanes, two generators set up one after the other give
+ * different numbers than a single one drawing the same total: output of
+ * bulk functions that set up lanes on every call depends on how the work is
+ * split into calls, though it is still reproducible from the seed.
+ *
+ * @param l Multi-lane generator to initialize.
+ * @param r Generator to split the lanes from; advanced by RNG_LANES jumps.
+ */
+void rng_lanes_init(struct rng_lanes *l, struct rng *r);
+
+/**
+ * @brief Fill an array with uniform 32-bit random numbers.
+ *
+ * Outputs are taken from the lanes in turn. Every call advances all lanes by
+ * the same number of steps, so n is rounded up to a multiple of RNG_LANES and
+ * the excess draws are discarded.
+ *
+ * @param l Multi-lane generator.
+ * @param out Output array of n numbers.
+ * @param n Number of values to generate.
+ */
+void rng_fill_u32(struct rng_lanes *l, uint32_t *out, size_t n);
+
+/**
+ * @brief Fill an array with uniform floats in [0, 1), as rng_float().
+ * @param l Multi-lane generator.
+ * @param out Output array of n floats.
+ * @param n Number of values to generate.
+ */
+void rng_fill_float(struct rng_lanes *l, float *out, size_t n);
+
+/**
+ * @brief Fill an array with uniform integers in [0, range), as rng_below().
+ * @param l Multi-lane generator.
+ * @param out Output array of n numbers.
+ * @param n Number of values to generate.
+ * @param range Number of possible values (at least 1).
+ */
+void rng_fill_below(struct rng_lanes *l, uint32_t *out, size_t n,
+                    uint32_t range);
+
+static inline uint32_t rng_rotl(uint32_t x, unsigned int k)
+{
+   return (x << k) | (x >> (32U - k));
+}
+
+/**
+ * @brief Generate a pseudorandom 32-bit unsigned integer.
+ * @param r Generator.
+ * @return A uniformly distributed 32-bit number.
+ */
+static inline uint32_t rng_next(struct rng *r)
+{
+   uint32_t *s = r->s;
+   const uint32_t result = rng_rotl(s[1] * 5U, 7U) * 9U;
+   const uint32_t t = s[1] << 9U;
+
+   s[2] ^= s[0];
+   s[3] ^= s[1];
+   s[1] ^= s[2];
+   s[0] ^= s[3];
+   s[2] ^= t;
+   s[3] = rng_rotl(s[3], 11U);
+
+   return result;
+}
+
+/**
+ * @brief Generate a pseudorandom integer in [0, range).
+ *
+ * Uses the high half of a 32x32-bit product, which is uniform up to a bias of
+ * range / 2^32.
+ *
+ * @param r Generator.
+ * @param range Number of possible values (at least 1).
+ * @return A number from 0 to range - 1.
+ */
+static inline uint32_t rng_below(struct rng *r, uint32_t range)
+{
+   return (uint32_t)(((uint64_t)rng_next(r) * range) >> 32U);
+}
+
+/**
+ * @brief Generate a pseudorandom float in [0, 1).
+ * @param r Generator.
+ * @return A float in [0, 1), with 24 random bits.
+ */
+static inline float rng_float(struct rng *r)
+{
+   return (float)(rng_next(r) >> 8U) * (1.0F / 16777216.0F);
+}
+
+#endif // RNG_H
+
+// end file rng.h
@@ -0,0 +1,42 @@
+/**
+ * @file span.h
+ * @brief Vectorized kernels for filling and summing spans of samples.
+ *
+ * Each kernel has a scalar version and, on x86, SSE2 and AVX2 versions,
+ * selected at runtime as described in cpu.h; all of them give bit-identical
+ * results.
+ *
+ * @author Jakob Kastelic
+ */
+
+#ifndef SPAN_H
+#define SPAN_H
+
+#include <stddef.h>
+
+/**
+ * @brief Set n samples to zero.
+ * @param dst Samples to clear.
+ * @param n Number of samples.
+ */
+void span_zero(float *dst, size_t n);
+
+/**
+ * @brief Copy n samples between non-overlapping spans.
+ * @param dst Destination.
+ * @param src Source.
+ * @param n Number of samples.
+ */
+void span_copy(float *restrict dst, const float *restrict src, size_t n);
+
+/**
+ * @brief Add n samples of src to dst.
+ * @param dst Accumulator.
+ * @param src Samples to add; must not overlap dst.
+ * @param n Number of samples.
+ */
+void span_add(float *restrict dst, const float *restrict src, size_t n);
+
+#endif // SPAN_H
+
+// end file span.h
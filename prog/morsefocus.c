@@ -14,6 +14,7 @@
 #include "diff.h"
 #include "gen.h"
 #include "record.h"
+#include "rng.h"
 #include "str.h"
 #include <stdio.h>
 #include <stdlib.h>
@@ -25,6 +26,11 @@
 #define TARGET_ACCURACY 0.1F
 #define PID_K 1.0F
 #define PROMPT_BUF_SIZE 16
+#define MAX_QRM 8           // most interfering stations
+#define QRM_SHIFT_MIN 80.0F // pitch offset of interferers, Hz
+#define QRM_SHIFT_MAX 400.0F
+#define QRM_MIN_FREQ 100.0F // lowest interferer pitch, Hz
+#define QRM_MAX_DELAY 3.0F  // latest interferer start after the delay, s
 
 struct ParsedArgs {
    float min_word;
@@ -32,7 +38,16 @@ struct ParsedArgs {
    float freq;
    float amp;
    float delay;
+   float rate;
+   float channels;
+   float period;
+   float periods;
+   float qrm;
+   float order;
    const char *file_name;
+   const char *render_file;
+   const char *backend;
+   const char *markov_file;
    struct record rec;
 };
 
@@ -52,12 +67,21 @@ static const struct ParsedArgs default_args = {
     .freq = 700.0F,
     .amp = 0.3F,
     .delay = 1.0F,
+    .rate = 48000.0F,
+    .channels = 2.0F,
+    .period = 64.0F,
+    .periods = 1.0F,
+    .qrm = 0.0F,
+    .order = 3.0F,
     .file_name = NULL,
+    .render_file = NULL,
+    .backend = NULL,
+    .markov_file = NULL,
     .rec = {.len = 250.0F, .speed1 = 25.0F, .speed2 = 25.0F, .scale = 1.0F},
 };
 
 static const struct ArgDef arg_defs[] = {
-    {"-n", "length", 1.0F, 1000.0F, &args.rec.len},
+    {"-n", "length", 1.0F, 10000.0F, &args.rec.len},
     {"-s", "scale", 0.001F, 1.0F, &args.rec.scale},
     {"-1", "speed1", 1.0F, 500.0F, &args.rec.speed1},
     {"-2", "speed2", 1.0F, 500.0F, &args.rec.speed2},
@@ -65,12 +89,19 @@ static const struct ArgDef arg_defs[] = {
     {"-x", "max word", 1.0F, 1000.0F, &args.max_word},
     {"-f", "frequency", 60.0F, 10000.0F, &args.freq},
     {"-a", "amplitude", 0.0F, 1.0F, &args.amp},
-    {"-w", "delay", 0.0F, 60.0F, &args.delay}};
+    {"-w", "delay", 0.0F, 60.0F, &args.delay},
+    {"-r", "sample rate", 8000.0F, 384000.0F, &args.rate},
+    {"-c", "channels", 1.0F, 8.0F, &args.channels},
+    {"-p", "period size", 16.0F, 65536.0F, &args.period},
+    {"-P", "periods", 1.0F, 16.0F, &args.periods},
+    {"-q", "interfering stations", 0.0F, (float)MAX_QRM, &args.qrm},
+    {"-o", "Markov order", 1.0F, (float)MARKOV_MAX_ORDER, &args.order}};
 
 static const char *usage =
     "Usage: %s file_name [options]\n\n"
     "Options:\n"
-    "  -n <num>     number of characters to generate (default: 250)\n"
+    "  -n <num>     number of characters to generate (1..10000), "
+    "default 250\n"
     "  -d <scale>   scale weights (default: 1.0)\n"
     "  -1 <speed>   Character speed in WPM (1..500), default 25\n"
     "  -2 <speed>   Farnsworth in WPM (1..500), default 25\n"
@@ -78,7 +109,20 @@ static const char *usage =
     "  -x <max>     set maximum word length (default 7)\n"
     "  -f <freq>    Tone frequency Hz (60..10000), default 700\n"
     "  -a <amp>     Amplitude (0..1), default 0.3\n"
-    "  -w <wait>    Initial delay seconds (0..60), default 1\n";
+    "  -w <wait>    Initial delay seconds (0..60), default 1\n"
+    "  -r <rate>    Sample rate Hz (8000..384000), default 48000\n"
+    "  -c <num>     Output channels (1..8), default 2\n"
+    "  -p <frames>  Audio period size in frames (16..65536), default 64\n"
+    "  -P <num>     Number of audio periods (1..16), default 1\n"
+    "  -b <name>    Audio backend, e.g. alsa, pulseaudio, jack, null\n"
+    "  -q <num>     Interfering stations sending random text (0..8), "
+    "default 0\n"
+    "  -m <words>   Send pseudo-words from a Markov chain trained on a word "
+    "file\n"
+    "  -o <order>   Characters of context of the Markov chain (1..4), "
+    "default 3\n"
+    "  --render <out.wav>\n"
+    "               write the audio to a WAV file instead of playing it\n";
 
 static int check_float_range(float val, float min, float max, const char *name)
 {
@@ -222,11 +266,25 @@ static int parse_args(int argc, char **argv)
       const struct ArgDef *def = NULL;
 
       // every optional argument needs a value
-      if (i++ >= argc) {
+      if (++i >= argc) {
          ERROR("missing value for argument %s\n", arg);
          exit(-1);
       }
 
+      // string-valued options
+      if (strcmp(arg, "--render") == 0) {
+         args.render_file = argv[i];
+         continue;
+      }
+      if (strcmp(arg, "-b") == 0) {
+         args.backend = argv[i];
+         continue;
+      }
+      if (strcmp(arg, "-m") == 0) {
+         args.markov_file = argv[i];
+         continue;
+      }
+
       // find the flag in arg_defs
       const size_t num_args = sizeof(arg_defs) / sizeof(arg_defs[0]);
       for (size_t j = 0; j < num_args; j++) {
@@ -265,30 +323,140 @@ static int parse_args(int argc, char **argv)
    return 0;
 }
 
-static char *alloc_and_generate(void)
+struct text_buf {
+   char *s;    // generated text
+   size_t len; // characters stored so far
+};
+
+static int text_sink(void *ctx, const char *buf, size_t len)
+{
+   struct text_buf *tb = (struct text_buf *)ctx;
+   memcpy(tb->s + tb->len, buf, len);
+   tb->len += len;
+   return 0;
+}
+
+static char *generate(const float *weights)
 {
-   const int len = (int)(args.rec.len + 2);
+   const size_t len = (size_t)args.rec.len;
 
-   char *buf = malloc(len);
+   char *buf = malloc(len + 1);
    if (!buf) {
       ERROR("out of memory");
       return NULL;
    }
 
-   if (!file_has_content(args.file_name))
-      for (int i = 0; i < MAX_CHARSET_LEN; i++)
-         args.rec.weights[i] = 1;
+   struct text_buf tb = {.s = buf, .len = 0};
+   if (gen_stream(text_sink, &tb, len, (int)args.min_word, (int)args.max_word,
+                  weights, NULL, 1, NULL) != 0) {
+      ERROR("gen_stream() failed");
+      free(buf);
+      return NULL;
+   }
+
+   buf[tb.len] = '\0';
+   str_trim(buf);
+   return buf;
+}
 
-   if (gen_chars(buf, len, (int)args.min_word, (int)args.max_word,
-                 args.rec.weights, NULL) != 0) {
-      ERROR("gen_chars() failed");
+/**
+ * @brief Generate pseudo-words from a Markov chain trained on the word file
+ * given with -m, with transitions into each character scaled by its weight.
+ */
+static char *generate_markov(const float *weights)
+{
+   struct word_dict wd;
+   if (word_dict_load(&wd, args.markov_file, 0) < 0) {
+      ERROR("could not load word file %s", args.markov_file);
+      return NULL;
+   }
+
+   struct markov m;
+   const int trained = markov_train(&m, (int)args.order, &wd, weights);
+   word_dict_free(&wd);
+   if (trained != 0)
+      return NULL;
+
+   const size_t len = (size_t)args.rec.len;
+   char *buf = malloc(len + 1);
+   if (!buf) {
+      ERROR("out of memory");
+      markov_free(&m);
+      return NULL;
+   }
+
+   if (markov_gen(&m, buf, len + 1, (int)args.min_word, (int)args.max_word,
+                  NULL) != 0) {
+      ERROR("markov_gen() failed");
+      markov_free(&m);
       free(buf);
       return NULL;
    }
 
+   markov_free(&m);
+   str_trim(buf);
    return buf;
 }
 
+static char *alloc_and_generate(void)
+{
+   if (!file_has_content(args.file_name))
+      for (int i = 0; i < MAX_CHARSET_LEN; i++)
+         args.rec.weights[i] = 1;
+
+   if (args.markov_file)
+      return generate_markov(args.rec.weights);
+   return generate(args.rec.weights);
+}
+
+static void free_voices(struct cw_voice *voices, int num)
+{
+   for (int v = 1; v < num; v++)
+      free((char *)voices[v].text);
+}
+
+/**
+ * @brief Add the interfering stations after the first voice: each sends its
+ * own uniformly random text, at a random pitch offset, speed and start time.
+ * The amplitudes are scaled down if they add up to more than 1.
+ */
+static int setup_qrm(struct cw_voice *voices, int num)
+{
+   struct rng *rng = rng_default();
+   const struct cw_data *cw = &voices[0].cw;
+   float amp_sum = cw->amp;
+
+   for (int v = 1; v < num; v++) {
+      char *text = generate(NULL);
+      if (!text) {
+         free_voices(voices, v);
+         return -1;
+      }
+
+      float shift = QRM_SHIFT_MIN +
+                    ((QRM_SHIFT_MAX - QRM_SHIFT_MIN) * rng_float(rng));
+      if (rng_below(rng, 2) == 0 && cw->freq - shift >= QRM_MIN_FREQ)
+         shift = -shift;
+      const float speed = cw->speed1 * (0.7F + (0.6F * rng_float(rng)));
+
+      struct cw_data *q = &voices[v].cw;
+      *q = *cw;
+      q->freq = cw->freq + shift;
+      q->amp = cw->amp * (0.3F + (0.7F * rng_float(rng)));
+      q->delay_sec = cw->delay_sec + (QRM_MAX_DELAY * rng_float(rng));
+      q->speed1 = speed;
+      q->speed2 = speed;
+      voices[v].text = text;
+      amp_sum += q->amp;
+   }
+
+   if (amp_sum > 1.0F)
+      for (int v = 0; v < num; v++)
+         voices[v].cw.amp /= amp_sum;
+
+   return 0;
+}
+
 static char *get_user_input(size_t maxlen)
 {
    if (maxlen < 2) {
@@ -341,18 +509,6 @@ int main(int argc, char **argv)
    if (!gen_buf)
       return -1;
 
-   // Initial stats
-   const float secs = cw_duration(gen_buf, args.rec.speed1, args.rec.speed2);
-   if (secs < 0)
-      return -1;
-   printf("Sending %.0f characters at %.1f/%.1f wpm (~%.1f min)\r\n",
-          args.rec.len, args.rec.speed1, args.rec.speed2, secs / SEC_PER_MIN);
-   printf("Received text? ");
-   if (fflush(stdout) != 0) {
-      ERROR("fflush failed");
-      return -1;
-   }
-
    // Arguments for the audio player
    struct cw_data cw = {
        .speed1 = args.rec.speed1,
@@ -360,10 +516,70 @@ int main(int argc, char **argv)
        .freq = args.freq,
        .amp = args.amp,
        .delay_sec = args.delay,
+       .sample_rate = (int)args.rate,
+       .channels = (int)args.channels,
+       .period_frames = (int)args.period,
+       .periods = (int)args.periods,
+       .backend = args.backend,
    };
 
+   // The station to copy, and any interfering ones
+   struct cw_voice voices[1 + MAX_QRM] = {{.text = gen_buf, .cw = cw}};
+   const int num = 1 + (int)args.qrm;
+   if (setup_qrm(voices, num) != 0) {
+      free(gen_buf);
+      return -1;
+   }
+
+   // Offline rendering: write the audio and the expected text, then quit
+   if (args.render_file) {
+      const int ms = cw_mix_wav(voices, num, args.render_file);
+      free_voices(voices, num);
+      if (ms < 0) {
+         free(gen_buf);
+         ERROR("error: rendering error\n");
+         return -1;
+      }
+      printf("Rendered %.0f characters at %.1f/%.1f wpm (~%.1f min) to %s\n",
+             args.rec.len, args.rec.speed1, args.rec.speed2,
+             (float)ms / 1000.0F / SEC_PER_MIN, args.render_file);
+      printf("Expected text: %s\n", gen_buf);
+      free(gen_buf);
+      return 0;
+   }
+
+   // Initial stats
+   const float secs = cw_duration(gen_buf, args.rec.speed1, args.rec.speed2);
+   if (secs < 0) {
+      free_voices(voices, num);
+      free(gen_buf);
+      return -1;
+   }
+
    // Play Morse code audio of generated text
-   if (cw_play(gen_buf, &cw) < 0) {
+   if (cw_mix_play_start(voices, num) < 0) {
+      free_voices(voices, num);
+      free(gen_buf);
+      ERROR("error: playback error\n");
+      return -1;
+   }
+
+   printf("Sending %.0f characters at %.1f/%.1f wpm (~%.1f min), "
+          "audio latency %.1f ms\r\n",
+          args.rec.len, args.rec.speed1, args.rec.speed2, secs / SEC_PER_MIN,
+          voices[0].cw.latency_ms);
+   printf("Received text? ");
+   if (fflush(stdout) != 0) {
+      ERROR("fflush failed");
+      cw_play_wait(&voices[0].cw);
+      free_voices(voices, num);
+      free(gen_buf);
+      return -1;
+   }
+
+   const int played = cw_play_wait(&voices[0].cw);
+   free_voices(voices, num);
+   if (played < 0) {
       free(gen_buf);
       ERROR("error: playback error\n");
       return -1;
@@ -0,0 +1,30 @@
+/**
+ * @file run_bench.c
+ * @brief Runs the benchmarks.
+ *
+ * @author Jakob Kastelic
+ */
+
+#include <stdio.h>
+
+#include "tests/bench_diff.h"
+#include "tests/bench_gen.h"
+
+#define BENCH_WORD_FILE "../../words/words.txt"
+#define BENCH_OUT_FILE "bench_out.txt"
+
+int main(int argc, char **argv)
+{
+   const char *word_file = (argc > 1) ? argv[1] : BENCH_WORD_FILE;
+   int ret = 0;
+
+   ret = ret || bench_write_words(word_file, BENCH_OUT_FILE);
+   ret = ret || bench_load_words(word_file);
+   ret = ret || bench_markov(word_file);
+   ret = ret || bench_lev_diff();
+   ret = ret || bench_lev_diff_modes();
+
+   return ret;
+}
+
+// end file run_bench.c
@@ -10,10 +10,16 @@
 
 #include "debug.h"
 
+#include "tests/test_alias.h"
+#include "tests/test_arena.h"
+#include "tests/test_cpu.h"
 #include "tests/test_cw.h"
 #include "tests/test_diff.h"
 #include "tests/test_gen.h"
 #include "tests/test_record.h"
+#include "tests/test_ring.h"
+#include "tests/test_rng.h"
+#include "tests/test_span.h"
 #include "tests/test_str.h"
 
 #define TEST_FILE1 "test_file.txt"
@@ -74,20 +80,51 @@ int main(void)
    ret = ret || test_record_append(TEST_FILE1);
 
    ret = ret || test_diff();
+   ret = ret || test_diff_ctx();
+   ret = ret || test_diff_modes();
+   ret = ret || test_diff_simd();
+
+   ret = ret || test_rng_next();
+   ret = ret || test_rng_streams();
+   ret = ret || test_rng_bulk();
+
+   ret = ret || test_alias_pick();
+   ret = ret || test_alias_invalid();
+   ret = ret || test_arena_alloc();
 
    ret = ret || test_gen_chars();
    ret = ret || test_free_entries();
    ret = ret || test_compute_total_weight();
    ret = ret || test_select_random_word();
+   ret = ret || test_word_sampler();
    ret = ret || test_write_words(TEST_FILE1);
    ret = ret || test_is_line_too_long(TEST_FILE1);
    ret = ret || test_validate_word();
    ret = ret || test_parse_line();
    ret = ret || test_parse_word_file(TEST_FILE1);
+   ret = ret || test_word_dict();
+   ret = ret || test_word_dict_load(TEST_FILE1);
    ret = ret || test_gen_words(TEST_FILE1, TEST_FILE2, TEST_FILE3);
+   ret = ret || test_gen_corpus(TEST_FILE1);
+   ret = ret || test_gen_stream();
+   ret = ret || test_markov();
+
+   ret = ret || test_ring_wrap();
+   ret = ret || test_ring_threads();
+
+   ret = ret || test_cpu_select();
+   ret = ret || test_span_kernels();
 
    ret = ret || test_ascii_to_morse_expanded();
    ret = ret || test_count_units();
+   ret = ret || test_cw_render();
+   ret = ret || test_cw_oscillator();
+   ret = ret || test_cw_sessions();
+   ret = ret || test_cw_render_wav(TEST_FILE1);
+   ret = ret || test_cw_mix();
+   ret = ret || test_cw_format();
+   ret = ret || test_cw_play_backend();
+   ret = ret || test_cw_mix_play();
 
    return ret;
 }
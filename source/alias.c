@@ -0,0 +1,107 @@
+/**
+ * @file alias.c
+ * @brief Walker/Vose alias tables for O(1) weighted sampling.
+ *
+ * @author Jakob Kastelic
+ */
+
+#include "alias.h"
+#include "debug.h"
+#include <stdint.h>
+#include <stdlib.h>
+
+#define ALIAS_ONE 4294967296.0
+
+void alias_free(struct alias *a)
+{
+   free(a->threshold);
+   free(a->alias);
+   a->threshold = NULL;
+   a->alias = NULL;
+   a->n = 0;
+}
+
+static uint32_t to_threshold(double p)
+{
+   if (p >= 1.0)
+      return UINT32_MAX;
+   if (p <= 0.0)
+      return 0;
+   return (uint32_t)(p * ALIAS_ONE);
+}
+
+int alias_init(struct alias *a, const float *weights, int n)
+{
+   if (!a || !weights || n < 1) {
+      ERROR("invalid parameters given");
+      return -1;
+   }
+
+   double sum = 0.0;
+   for (int i = 0; i < n; i++) {
+      if (!(weights[i] >= 0.0F)) {
+         ERROR("negative or invalid weight at index %d", i);
+         return -1;
+      }
+      sum += (double)weights[i];
+   }
+
+   if (sum <= 0.0) {
+      ERROR("weights sum to zero");
+      return -1;
+   }
+
+   a->n = n;
+   a->threshold = malloc(sizeof(uint32_t) * (size_t)n);
+   a->alias = malloc(sizeof(int) * (size_t)n);
+   double *p = malloc(sizeof(double) * (size_t)n);
+   int *work = malloc(sizeof(int) * (size_t)n);
+   if (!a->threshold || !a->alias || !p || !work) {
+      ERROR("out of memory");
+      free(p);
+      free(work);
+      alias_free(a);
+      return -1;
+   }
+
+   // scaled probabilities; small ones fill the work list from the front,
+   // large ones from the back
+   int small = 0;
+   int large = n;
+   for (int i = 0; i < n; i++) {
+      p[i] = (double)weights[i] * (double)n / sum;
+      a->alias[i] = i;
+      if (p[i] < 1.0)
+         work[small++] = i;
+      else
+         work[--large] = i;
+   }
+
+   // Vose: pair each small column with a large one that tops it up
+   int s = 0;
+   while (s < small && large < n) {
+      const int lo = work[s++];
+      const int hi = work[large];
+
+      a->threshold[lo] = to_threshold(p[lo]);
+      a->alias[lo] = hi;
+
+      p[hi] -= 1.0 - p[lo];
+      if (p[hi] < 1.0) {
+         large++;
+         work[small++] = hi;
+      }
+   }
+
+   // what is left is full up to rounding error
+   for (int i = s; i < small; i++)
+      a->threshold[work[i]] = UINT32_MAX;
+   for (int i = large; i < n; i++)
+      a->threshold[work[i]] = UINT32_MAX;
+
+   free(p);
+   free(work);
+   return 0;
+}
+
+// end file alias.c
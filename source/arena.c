@@ -0,0 +1,89 @@
+/**
+ * @file arena.c
+ * @brief Bump allocator for data that is freed all at once.
+ *
+ * @author Jakob Kastelic
+ */
+
+#include "arena.h"
+#include "debug.h"
+#include <stdint.h>
+#include <stdlib.h>
+
+#define ARENA_ALIGN 16
+
+struct arena_block {
+   struct arena_block *next; // older block
+   size_t size;              // usable bytes in data
+   size_t used;              // bytes handed out so far
+   unsigned char *data;      // aligned start of the usable bytes
+};
+
+static size_t align_up(size_t n)
+{
+   return (n + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+void arena_init(struct arena *a, size_t block_size)
+{
+   a->head = NULL;
+   a->block_size = block_size;
+}
+
+static struct arena_block *arena_grow(struct arena *a, size_t size)
+{
+   const size_t want = (size > a->block_size) ? size : a->block_size;
+   const size_t hdr = align_up(sizeof(struct arena_block));
+   if (want > SIZE_MAX - hdr - ARENA_ALIGN) {
+      ERROR("arena allocation too large");
+      return NULL;
+   }
+
+   struct arena_block *b = malloc(hdr + want + ARENA_ALIGN);
+   if (!b) {
+      ERROR("out of memory");
+      return NULL;
+   }
+
+   // malloc() only guarantees alignment for the standard types
+   const uintptr_t start = (uintptr_t)b + hdr;
+   b->data = (unsigned char *)b + hdr + (align_up(start) - start);
+   b->size = want;
+   b->used = 0;
+   b->next = a->head;
+   a->head = b;
+   return b;
+}
+
+void *arena_alloc(struct arena *a, size_t size)
+{
+   if (size > SIZE_MAX - ARENA_ALIGN) {
+      ERROR("arena allocation too large");
+      return NULL;
+   }
+   size = align_up(size);
+
+   struct arena_block *b = a->head;
+   if (!b || b->size - b->used < size) {
+      b = arena_grow(a, size);
+      if (!b)
+         return NULL;
+   }
+
+   void *p = b->data + b->used;
+   b->used += size;
+   return p;
+}
+
+void arena_free(struct arena *a)
+{
+   struct arena_block *b = a->head;
+   while (b) {
+      struct arena_block *next = b->next;
+      free(b);
+      b = next;
+   }
+   a->head = NULL;
+}
+
+// end file arena.c
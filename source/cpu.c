@@ -0,0 +1,55 @@
+/**
+ * @file cpu.c
+ * @brief Runtime selection of the instruction set of vectorized kernels.
+ *
+ * @author Jakob Kastelic
+ */
+
+#include "cpu.h"
+#include <pthread.h>
+
+static enum cpu_isa selected = CPU_SCALAR;
+static pthread_once_t select_once = PTHREAD_ONCE_INIT;
+
+int cpu_supports(enum cpu_isa isa)
+{
+   switch (isa) {
+   case CPU_SCALAR:
+      return 1;
+#ifdef CPU_X86
+   case CPU_SSE2:
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("sse2") ? 1 : 0;
+   case CPU_AVX2:
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("avx2") ? 1 : 0;
+#endif
+   default:
+      return 0;
+   }
+}
+
+static void select_best(void)
+{
+   if (cpu_supports(CPU_AVX2))
+      selected = CPU_AVX2;
+   else if (cpu_supports(CPU_SSE2))
+      selected = CPU_SSE2;
+}
+
+enum cpu_isa cpu_isa(void)
+{
+   pthread_once(&select_once, select_best);
+   return selected;
+}
+
+int cpu_set_isa(enum cpu_isa isa)
+{
+   pthread_once(&select_once, select_best);
+   if (!cpu_supports(isa))
+      return -1;
+   selected = isa;
+   return 0;
+}
+
+// end file cpu.c
@@ -8,10 +8,14 @@
 #include "cw.h"
 #include "debug.h"
 #include "lib/miniaudio.h"
+#include "ring.h"
+#include "span.h"
 #include <ctype.h>
 #include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdlib.h>
-#include <string.h>
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
@@ -19,6 +23,24 @@
 
 #define INITIAL_SILENCE 250
 #define FADE_LEN 100
+#define SINE_BITS 10
+#define SINE_LEN (1 << SINE_BITS)
+#define PHASE_FRAC_BITS (32 - SINE_BITS)
+
+#define DEFAULT_SAMPLE_RATE 48000
+#define DEFAULT_CHANNELS 2
+#define DEFAULT_PERIOD_FRAMES 64
+#define DEFAULT_PERIODS 1
+#define MIN_SAMPLE_RATE 8000
+#define MAX_SAMPLE_RATE 384000
+#define MAX_CHANNELS 8
+#define WAV_CHUNK 4096
+#define WAV_MAX_SIZE 0xFFFFFFFFUL // largest RIFF chunk size
+#define WAV_HEADER_SIZE 36UL     // RIFF chunk bytes before the samples
+#define MIX_BLOCK 1024
+
+#define RING_FRAMES 8192
+#define WORKER_BLOCK 512
 
 #define INTER_GAP 1
 #define CHAR_GAP 3
@@ -26,6 +48,40 @@
 #define DAH_DUR 3
 #define WORD_BREAK 7
 
+struct osc {
+   uint32_t phase; // oscillator phase, 2^32 is a full period
+   uint32_t inc;   // phase increment per sample
+   float amp;      // tone amplitude
+};
+
+/**
+ * @brief Source of audio for wav_write() and the player: render the next
+ * frames into buf.
+ */
+typedef void (*frame_source)(void *ctx, float *buf, size_t frames);
+
+struct mix {
+   struct cw_voice *voices;
+   int num;
+};
+
+struct cw_player {
+   struct cw_data *cw;  // session being played, or the first voice of a mix
+   struct mix mix;      // voices of a mix, or none for a single session
+   frame_source src;    // renders the session or the mix
+   void *src_ctx;       // passed to src
+   long total;          // frames to play
+   ma_context ctx;      // audio context for the selected backend
+   ma_device dev;       // playback device
+   struct ring ring;    // rendered frames, worker to audio callback
+   pthread_t worker;    // synthesis thread
+   ma_event done;       // signalled by the callback after the last frame
+   ma_event space;      // signalled by the callback when the worker waits
+   atomic_int waiting;  // worker waits for room in the ring
+   atomic_int finished; // worker has written the last frame
+   atomic_int drained;  // callback has played the last frame
+};
+
 static const char *const morse_table[] = {
     ['A'] = ".-",      ['B'] = "-...",   ['C'] = "-.-.",   ['D'] = "-..",
     ['E'] = ".",       ['F'] = "..-.",   ['G'] = "--.",    ['H'] = "....",
@@ -45,20 +101,26 @@ static const char *const morse_table[] = {
     ['+'] = ".-.-.",   ['-'] = "-....-", ['_'] = "..--.-", ['"'] = ".-..-.",
     ['$'] = "...-..-", ['@'] = ".--.-."};
 
-void ascii_to_morse_expanded(const char *in, char *out)
+void morse_enc_init(struct morse_enc *enc, const char *in)
 {
-   size_t pos = 0;
-   int first_char = 1;
+   enc->in = in;
+   enc->code = "";
+   enc->first_char = 1;
+}
 
-   while (*in) {
-      unsigned char c = (unsigned char)*in;
+char morse_enc_next(struct morse_enc *enc)
+{
+   while (!*enc->code) {
+      unsigned char c = (unsigned char)*enc->in;
+      if (!c)
+         return '\0';
+      enc->in++;
 
       if (c == ' ') {
-         if (!first_char) {
-            out[pos++] = '/'; /* Word gap */
+         if (!enc->first_char) {
+            enc->first_char = 1;
+            return '/'; /* Word gap */
          }
-         in++;
-         first_char = 1;
          continue;
       }
 
@@ -66,21 +128,27 @@ void ascii_to_morse_expanded(const char *in, char *out)
 
       const int tbl_size = sizeof(morse_table) / sizeof(morse_table[0]);
       const char *mc = (c < tbl_size) ? morse_table[c] : NULL;
-      if (!mc) {
-         in++;
+      if (!mc)
          continue;
-      }
-
-      if (!first_char) {
-         out[pos++] = '|'; /* Character gap */
-      }
 
-      for (size_t i = 0; mc[i]; i++) {
-         out[pos++] = mc[i];
-      }
-      in++;
-      first_char = 0;
+      enc->code = mc;
+      if (!enc->first_char)
+         return '|'; /* Character gap */
+      enc->first_char = 0;
    }
+
+   enc->first_char = 0;
+   return *enc->code++;
+}
+
+void ascii_to_morse_expanded(const char *in, char *out)
+{
+   struct morse_enc enc;
+   morse_enc_init(&enc, in);
+
+   size_t pos = 0;
+   for (char sym = morse_enc_next(&enc); sym; sym = morse_enc_next(&enc))
+      out[pos++] = sym;
    out[pos] = '\0';
 }
 
@@ -118,196 +186,855 @@ int count_units(const char *morse)
    return units;
 }
 
-static void start_symbol_tone(struct cw_data *cw, char sym)
+static void symbol_samples(const struct cw_data *cw, char sym, int *tone,
+                           int *gap)
 {
    switch (sym) {
    case '.':
-      cw->tone_samples = cw->dot_len;
-      cw->gap_samples = cw->intra_gap;
+      *tone = cw->dot_len;
+      *gap = cw->intra_gap;
       break;
    case '-':
-      cw->tone_samples = 3 * cw->dot_len;
-      cw->gap_samples = cw->intra_gap;
+      *tone = 3 * cw->dot_len;
+      *gap = cw->intra_gap;
       break;
    case '|':
-      cw->tone_samples = 0;
-      cw->gap_samples = cw->inter_gap * 3;
+      *tone = 0;
+      *gap = cw->inter_gap * 3;
       break;
    case '/':
-      cw->tone_samples = 0;
-      cw->gap_samples = cw->inter_gap * 7;
+      *tone = 0;
+      *gap = cw->inter_gap * 7;
       break;
    case ' ':
    default:
-      cw->tone_samples = 0;
-      cw->gap_samples = cw->intra_gap;
+      *tone = 0;
+      *gap = cw->intra_gap;
       break;
    }
+}
+
+static void start_symbol_tone(struct cw_data *cw, char sym)
+{
+   symbol_samples(cw, sym, &cw->tone_samples, &cw->gap_samples);
    cw->tone_len = cw->tone_samples;
+   cw->wave = (sym == '-') ? cw->dah_wave : cw->dit_wave;
 }
 
-// Callback from miniaudio.h library, cannot change prototype:
-// NOLINTNEXTLINE(bugprone-easily-swappable-parameters)
-static void data_callback(ma_device *pDevice, void *pOutput, const void *pInput,
-                          ma_uint32 frameCount)
+// one period of sin(), plus a guard point, and the keying envelope,
+// fade[k] = gain at k samples; shared by all sessions
+static float sine[SINE_LEN + 1];
+static float fade[FADE_LEN + 1];
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+
+static void fill_tables(void)
 {
-   (void)pInput;
-   struct cw_data *cw = (struct cw_data *)pDevice->pUserData;
-   float *out = (float *)pOutput;
+   for (int k = 0; k <= SINE_LEN; k++)
+      sine[k] = (float)sin(2.0 * M_PI * k / SINE_LEN);
 
-   static int initial = -1;
-   if (initial == -1) {
-      initial = cw->delay_frames;
-   } else if (initial > 0) {
-      initial--;
-      memset(out, 0, sizeof(float) * 2 * frameCount);
-      return;
+   for (int k = 0; k <= FADE_LEN; k++)
+      fade[k] = (float)k / (float)FADE_LEN;
+}
+
+/**
+ * @brief Start an oscillator at zero phase for the configured tone.
+ *
+ * The per-sample work is a lookup in the shared sine table with linear
+ * interpolation.
+ */
+static struct osc osc_start(const struct cw_data *cw)
+{
+   const double cycles = fmod((double)cw->freq / (double)cw->sample_rate, 1.0);
+   struct osc o = {
+       .phase = 0, .inc = (uint32_t)(cycles * 4294967296.0), .amp = cw->amp};
+   return o;
+}
+
+/**
+ * @brief Return the next oscillator sample and advance the phase.
+ */
+static float osc_next(struct osc *o)
+{
+   const uint32_t idx = o->phase >> PHASE_FRAC_BITS;
+   const uint32_t mask = (1UL << PHASE_FRAC_BITS) - 1;
+   const float frac =
+       (float)(o->phase & mask) * (1.0F / (float)(1UL << PHASE_FRAC_BITS));
+
+   o->phase += o->inc;
+   return o->amp * (sine[idx] + (frac * (sine[idx + 1] - sine[idx])));
+}
+
+static void setup_timing(struct cw_data *cw, const float sr)
+{
+   float dot_dur = 60.0F / (50.0F * cw->speed1);
+   float gap_dur = 60.0F / (50.0F * cw->speed2);
+
+   cw->dot_len = (int)(dot_dur * sr);
+   cw->intra_gap = cw->dot_len;
+   cw->inter_gap = (int)(gap_dur * sr);
+}
+
+/**
+ * @brief Render one keyed element, with its fade ramps, into a new buffer of
+ * len interleaved frames.
+ */
+static float *render_element(const struct cw_data *cw, int len)
+{
+   const int ch = cw->channels;
+   const size_t frames = (size_t)(len > 0 ? len : 1);
+   float *wave = malloc(sizeof(float) * (size_t)ch * frames);
+   if (!wave) {
+      ERROR("out of memory");
+      return NULL;
    }
 
-   for (size_t i = 0; i < frameCount; i++) {
-      float sample = 0.0F;
+   struct osc o = osc_start(cw);
+   for (int k = 0; k < len; k++) {
+      float sample = osc_next(&o);
 
-      if (cw->tone_samples > 0) {
-         unsigned long long tone_played =
-             cw->tone_len - cw->tone_samples; // samples played in current tone
-         float fade_factor = 1.0F;
+      // Fade-in over first FADE_LEN samples, fade-out over the last
+      if (k < FADE_LEN)
+         sample *= fade[k];
+      else if (len - k < FADE_LEN)
+         sample *= fade[len - k];
 
-         // Fade-in over first FADE_LEN samples
-         if (tone_played < FADE_LEN) {
-            fade_factor = (float)tone_played / (float)FADE_LEN;
-         }
-         // Fade-out over last FADE_LEN samples
-         else if (cw->tone_samples < FADE_LEN) {
-            fade_factor = (float)cw->tone_samples / (float)FADE_LEN;
-         }
+      for (int c = 0; c < ch; c++)
+         wave[(k * ch) + c] = sample;
+   }
 
-         const float sr = (float)pDevice->sampleRate;
-         const float r = (float)(cw->total_samples % pDevice->sampleRate) / sr;
-         sample =
-             fade_factor * cw->amp * sinf(2.0F * (float)M_PI * cw->freq * r);
+   return wave;
+}
 
-         cw->tone_samples--;
+/**
+ * @brief Pre-render the dit and dah waveforms for the current configuration.
+ */
+static int setup_elements(struct cw_data *cw)
+{
+   cw->dit_wave = render_element(cw, cw->dot_len);
+   cw->dah_wave = render_element(cw, DAH_DUR * cw->dot_len);
+   if (!cw->dit_wave || !cw->dah_wave)
+      return -1;
+   return 0;
+}
+
+/**
+ * @brief Synthesize the next frames of the Morse stream into an interleaved
+ * stereo buffer, advancing the playback state.
+ *
+ * Tones are copied in spans from the element cache and gaps are cleared in
+ * spans with the vectorized span kernels, so the cost per frame does not
+ * depend on the tone and long spans run at memory bandwidth.
+ */
+static void synth_frames(struct cw_data *cw, float *out, size_t frames)
+{
+   const size_t ch = (size_t)cw->channels;
+
+   for (size_t i = 0; i < frames;) {
+      size_t n = frames - i;
+      float *dst = out + (i * ch);
+
+      // initial delay
+      if (cw->delay_samples > 0) {
+         if ((size_t)cw->delay_samples < n)
+            n = (size_t)cw->delay_samples;
+         span_zero(dst, n * ch);
+         cw->delay_samples -= (long)n;
+      }
+
+      else if (cw->tone_samples > 0) {
+         const int tone_played = cw->tone_len - cw->tone_samples;
+         if ((size_t)cw->tone_samples < n)
+            n = (size_t)cw->tone_samples;
+         span_copy(dst, cw->wave + ((size_t)tone_played * ch), n * ch);
+         cw->tone_samples -= (int)n;
       }
 
       // when waiting in silence
       else if (cw->gap_samples > 0) {
-         sample = 0.0F;
-         cw->gap_samples--;
+         if ((size_t)cw->gap_samples < n)
+            n = (size_t)cw->gap_samples;
+         span_zero(dst, n * ch);
+         cw->gap_samples -= (int)n;
+      }
+
+      // one silent frame to fetch the next symbol
+      else if (cw->sym) {
+         n = 1;
+         span_zero(dst, ch);
+         start_symbol_tone(cw, cw->sym);
+         cw->sym = morse_enc_next(&cw->enc);
+      }
+
+      // silence after the end
+      else {
+         span_zero(dst, n * ch);
       }
 
-      else if (cw->morse[cw->pos]) {
-         char sym = cw->morse[cw->pos++];
-         start_symbol_tone(cw, sym);
-         sample = 0.0F;
-      } else {
-         sample = 0.0F;
+      i += n;
+      cw->total_samples += n;
+   }
+}
+
+/**
+ * @brief Count the frames synth_frames() needs to play out the rest of the
+ * session: the initial delay, then for each symbol one silent frame to fetch
+ * it, its tone and its gap.
+ */
+static long count_frames(const struct cw_data *cw)
+{
+   struct morse_enc enc = cw->enc;
+   long frames = cw->delay_samples + cw->tone_samples + cw->gap_samples;
+
+   for (char sym = cw->sym; sym; sym = morse_enc_next(&enc)) {
+      int tone = 0;
+      int gap = 0;
+      symbol_samples(cw, sym, &tone, &gap);
+      frames += 1L + tone + gap;
+   }
+   return frames;
+}
+
+/**
+ * @brief Block until the ring has room for n samples.
+ *
+ * The worker announces that it waits, then checks the ring once more before
+ * it sleeps, so that a callback which frees the room in between is bound to
+ * see the flag and wake it.
+ */
+static void wait_for_space(struct cw_player *pl, size_t n)
+{
+   while (ring_writable(&pl->ring) < n) {
+      atomic_store(&pl->waiting, 1);
+      atomic_thread_fence(memory_order_seq_cst);
+      if (ring_writable(&pl->ring) >= n)
+         break;
+      ma_event_wait(&pl->space);
+   }
+}
+
+/**
+ * @brief Synthesis thread: render the whole session or mix into the ring
+ * buffer, staying at most RING_FRAMES ahead of the audio callback.
+ */
+static void *synth_worker(void *arg)
+{
+   struct cw_player *pl = (struct cw_player *)arg;
+   const size_t ch = (size_t)pl->cw->channels;
+   float block[WORKER_BLOCK * MAX_CHANNELS];
+
+   long left = pl->total;
+   while (left > 0) {
+      const size_t n = (left < WORKER_BLOCK) ? (size_t)left : WORKER_BLOCK;
+
+      wait_for_space(pl, n * ch);
+
+      pl->src(pl->src_ctx, block, n);
+      ring_write(&pl->ring, block, n * ch);
+      left -= (long)n;
+   }
+
+   atomic_store_explicit(&pl->finished, 1, memory_order_release);
+   return NULL;
+}
+
+// Callback from miniaudio.h library, cannot change prototype:
+// NOLINTNEXTLINE(bugprone-easily-swappable-parameters)
+static void data_callback(ma_device *pDevice, void *pOutput, const void *pInput,
+                          ma_uint32 frameCount)
+{
+   (void)pInput;
+   struct cw_player *pl = (struct cw_player *)pDevice->pUserData;
+   float *out = (float *)pOutput;
+   const size_t want = (size_t)frameCount * pDevice->playback.channels;
+
+   const size_t got = ring_read(&pl->ring, out, want);
+   span_zero(out + got, want - got);
+
+   // wake the worker only when it waits for the room just freed
+   atomic_thread_fence(memory_order_seq_cst);
+   if (atomic_load_explicit(&pl->waiting, memory_order_relaxed) &&
+       atomic_exchange(&pl->waiting, 0))
+      ma_event_signal(&pl->space);
+
+   // signal completion once, when the last gap has been played
+   if (!atomic_load_explicit(&pl->drained, memory_order_relaxed) &&
+       atomic_load_explicit(&pl->finished, memory_order_acquire) &&
+       ring_readable(&pl->ring) == 0) {
+      atomic_store_explicit(&pl->drained, 1, memory_order_release);
+      ma_event_signal(&pl->done);
+   }
+}
+
+/**
+ * @brief Look up a miniaudio backend by its name, ignoring case.
+ */
+static int backend_from_name(const char *name, ma_backend *backend)
+{
+   for (int b = 0; b <= (int)ma_backend_null; b++) {
+      const char *p = ma_get_backend_name((ma_backend)b);
+      const char *q = name;
+      while (*p && tolower((unsigned char)*p) == tolower((unsigned char)*q)) {
+         p++;
+         q++;
+      }
+      if (*p == '\0' && *q == '\0') {
+         *backend = (ma_backend)b;
+         return 0;
       }
+   }
+   return -1;
+}
+
+/**
+ * @brief Open the audio context for the requested backend, or for the default
+ * list of backends if none is given.
+ */
+static int setup_audio_context(struct cw_player *pl)
+{
+   const struct cw_data *cw = pl->cw;
+   ma_backend backend;
 
-      out[i * 2] = sample;
-      out[(i * 2) + 1] = sample;
-      cw->total_samples++;
+   if (!cw->backend)
+      return (ma_context_init(NULL, 0, NULL, &pl->ctx) == MA_SUCCESS) ? 0 : -1;
+
+   if (backend_from_name(cw->backend, &backend) != 0) {
+      ERROR("unknown audio backend '%s'", cw->backend);
+      return -1;
+   }
+
+   if (ma_context_init(&backend, 1, NULL, &pl->ctx) != MA_SUCCESS) {
+      ERROR("audio backend '%s' not available", cw->backend);
+      return -1;
    }
+
+   return 0;
 }
 
-static int setup_audio_device(struct cw_data *cw, ma_device *dev)
+/**
+ * @brief Open and start the playback device, and report its latency.
+ */
+static int setup_audio_device(struct cw_player *pl)
 {
+   struct cw_data *cw = pl->cw;
+   ma_device *dev = &pl->dev;
    ma_device_config cfg = ma_device_config_init(ma_device_type_playback);
    cfg.playback.format = ma_format_f32;
-   cfg.playback.channels = 2;
-   cfg.sampleRate = 48000;
-   cfg.periodSizeInFrames = 64;
-   cfg.periods = 1;
+   cfg.playback.channels = (ma_uint32)cw->channels;
+   cfg.sampleRate = (ma_uint32)cw->sample_rate;
+   cfg.periodSizeInFrames = (ma_uint32)cw->period_frames;
+   cfg.periods = (ma_uint32)cw->periods;
    cfg.dataCallback = data_callback;
+   cfg.pUserData = pl;
 
-   const float sr = (float)cfg.sampleRate;
-   const float ratio = sr / (float)cfg.periodSizeInFrames;
+   if (ma_device_init(&pl->ctx, &cfg, dev) != MA_SUCCESS)
+      return -1;
+
+   // latency of the buffering actually negotiated with the backend
+   const ma_uint32 rate = dev->playback.internalSampleRate;
+   const ma_uint32 frames =
+       dev->playback.internalPeriodSizeInFrames * dev->playback.internalPeriods;
+   cw->latency_ms = (rate > 0) ? (1000.0F * (float)frames / (float)rate) : 0;
 
-   // Calculate delay_frames if not set yet (optional)
-   if (cw->delay_frames == 0 && cw->delay_sec > 0.0F) {
-      cw->delay_frames = (int)(cw->delay_sec * ratio);
+   if (ma_device_start(dev) != MA_SUCCESS) {
+      ma_device_uninit(dev);
+      return -1;
    }
 
-   float dot_dur = 60.0F / (50.0F * cw->speed1);
-   float gap_dur = 60.0F / (50.0F * cw->speed2);
+   return 0;
+}
 
-   cw->dot_len = (int)(dot_dur * sr);
-   cw->intra_gap = cw->dot_len;
-   cw->inter_gap = (int)(gap_dur * sr);
+static int check_params(const char *str, const struct cw_data *cw)
+{
+   if (!str || !cw) {
+      ERROR("invalid parameters given");
+      return -1;
+   }
 
-   cfg.pUserData = cw;
+   if (cw->speed1 <= 0 || cw->speed2 <= 0 || cw->freq <= 0 || cw->amp <= 0) {
+      ERROR("invalid parameters given");
+      return -1;
+   }
 
-   if (ma_device_init(NULL, &cfg, dev) != MA_SUCCESS)
+   if (cw->speed1 < cw->speed2) {
+      ERROR("speed1 must be equal or greater than speed2");
       return -1;
+   }
 
-   if (ma_device_start(dev) != MA_SUCCESS) {
-      ma_device_uninit(dev);
+   if ((cw->sample_rate != 0 && (cw->sample_rate < MIN_SAMPLE_RATE ||
+                                 cw->sample_rate > MAX_SAMPLE_RATE)) ||
+       cw->channels < 0 || cw->channels > MAX_CHANNELS ||
+       cw->period_frames < 0 || cw->periods < 0) {
+      ERROR("invalid audio format given");
       return -1;
    }
 
-   return (int)cfg.sampleRate;
+   return 0;
 }
 
-static char *prepare_morse(const char *str)
+/**
+ * @brief Replace unset (zero) audio parameters with the defaults.
+ *
+ * The defaults are written into the caller's struct, as documented for
+ * cw_play(), so that the format actually used can be read back from it.
+ */
+static void set_defaults(struct cw_data *cw)
 {
-   char *morse = malloc((strlen(str) * 10) + 1);
-   if (!morse) {
+   if (cw->sample_rate == 0)
+      cw->sample_rate = DEFAULT_SAMPLE_RATE;
+   if (cw->channels == 0)
+      cw->channels = DEFAULT_CHANNELS;
+   if (cw->period_frames == 0)
+      cw->period_frames = DEFAULT_PERIOD_FRAMES;
+   if (cw->periods == 0)
+      cw->periods = DEFAULT_PERIODS;
+}
+
+/**
+ * @brief Release the element cache of a session.
+ */
+static void end_session(struct cw_data *cw)
+{
+   free(cw->dit_wave);
+   free(cw->dah_wave);
+   cw->dit_wave = NULL;
+   cw->dah_wave = NULL;
+   cw->wave = NULL;
+}
+
+/**
+ * @brief Validate parameters, start encoding the text and set up the
+ * synthesizer for the configured audio format. On success, end_session() must
+ * be called afterwards.
+ */
+static int start_session(const char *str, struct cw_data *cw)
+{
+   if (check_params(str, cw) != 0)
+      return -1;
+
+   set_defaults(cw);
+   const float sr = (float)cw->sample_rate;
+
+   morse_enc_init(&cw->enc, str);
+   cw->sym = morse_enc_next(&cw->enc);
+   cw->tone_samples = 0;
+   cw->tone_len = 0;
+   cw->gap_samples = 0;
+   cw->total_samples = 0;
+   cw->delay_samples = (long)(cw->delay_sec * sr);
+
+   setup_timing(cw, sr);
+   if (pthread_once(&tables_once, fill_tables) != 0 ||
+       setup_elements(cw) != 0) {
+      end_session(cw);
+      return -1;
+   }
+
+   return 0;
+}
+
+static void session_source(void *ctx, float *buf, size_t frames)
+{
+   synth_frames((struct cw_data *)ctx, buf, frames);
+}
+
+static void end_voices(struct cw_voice *voices, int num)
+{
+   for (int v = 0; v < num; v++)
+      end_session(&voices[v].cw);
+}
+
+/**
+ * @brief Render the next frames of all voices and sum them into out.
+ *
+ * Each voice is rendered a cache-sized block at a time into a scratch buffer
+ * and accumulated with the vectorized span_add().
+ */
+static void mix_frames(struct cw_voice *voices, int num, float *out,
+                       size_t frames)
+{
+   const size_t ch = (size_t)voices[0].cw.channels;
+   float scratch[MIX_BLOCK * MAX_CHANNELS];
+
+   span_zero(out, frames * ch);
+
+   for (size_t i = 0; i < frames; i += MIX_BLOCK) {
+      const size_t n = (frames - i < MIX_BLOCK) ? frames - i : MIX_BLOCK;
+      for (int v = 0; v < num; v++) {
+         synth_frames(&voices[v].cw, scratch, n);
+         span_add(out + (i * ch), scratch, n * ch);
+      }
+   }
+}
+
+static void mix_source(void *ctx, float *buf, size_t frames)
+{
+   struct mix *m = (struct mix *)ctx;
+   mix_frames(m->voices, m->num, buf, frames);
+}
+
+/**
+ * @brief Open the audio device and start the worker rendering total frames of
+ * a started session, or of a mix of started sessions if mix is given, whose
+ * first voice is cw. The sessions are not ended on failure.
+ */
+static int player_start(struct cw_data *cw, const struct mix *mix, long total)
+{
+   struct cw_player *pl = calloc(1, sizeof(struct cw_player));
+   if (!pl) {
       ERROR("out of memory");
-      return NULL;
+      return -1;
    }
 
-   ascii_to_morse_expanded(str, morse);
-   return morse;
+   pl->cw = cw;
+   pl->total = total;
+   if (mix) {
+      pl->mix = *mix;
+      pl->src = mix_source;
+      pl->src_ctx = &pl->mix;
+   } else {
+      pl->src = session_source;
+      pl->src_ctx = cw;
+   }
+   atomic_init(&pl->waiting, 0);
+   atomic_init(&pl->finished, 0);
+   atomic_init(&pl->drained, 0);
+
+   if (ring_init(&pl->ring, (size_t)RING_FRAMES * (size_t)cw->channels) != 0)
+      goto fail_ring;
+
+   if (ma_event_init(&pl->done) != MA_SUCCESS) {
+      ERROR("cannot create completion event");
+      goto fail_event;
+   }
+
+   if (ma_event_init(&pl->space) != MA_SUCCESS) {
+      ERROR("cannot create worker event");
+      goto fail_space;
+   }
+
+   if (setup_audio_context(pl) != 0) {
+      ERROR("audio context setup failed");
+      goto fail_context;
+   }
+
+   if (setup_audio_device(pl) != 0) {
+      ERROR("audio device setup failed");
+      goto fail_device;
+   }
+
+   if (pthread_create(&pl->worker, NULL, synth_worker, pl) != 0) {
+      ERROR("cannot start synthesis thread");
+      goto fail_thread;
+   }
+
+   cw->player = pl;
+   return 0;
+
+fail_thread:
+   ma_device_uninit(&pl->dev);
+fail_device:
+   ma_context_uninit(&pl->ctx);
+fail_context:
+   ma_event_uninit(&pl->space);
+fail_space:
+   ma_event_uninit(&pl->done);
+fail_event:
+   ring_free(&pl->ring);
+fail_ring:
+   free(pl);
+   return -1;
 }
 
-static int wait_for_playback_to_finish(struct cw_data *cw)
+int cw_play_start(const char *str, struct cw_data *cw)
 {
-   while (cw->morse[cw->pos] || cw->tone_samples > 0 || cw->gap_samples > 0) {
-      ma_sleep(10);
+   if (start_session(str, cw) != 0)
+      return -1;
+
+   if (player_start(cw, NULL, count_frames(cw)) != 0) {
+      end_session(cw);
+      return -1;
    }
 
    return 0;
 }
 
+int cw_play_wait(struct cw_data *cw)
+{
+   if (!cw || !cw->player) {
+      ERROR("no playback in progress");
+      return -1;
+   }
+
+   struct cw_player *pl = cw->player;
+   int ret = 0;
+
+   if (ma_event_wait(&pl->done) != MA_SUCCESS) {
+      ERROR("waiting for playback failed");
+      ret = -1;
+   }
+
+   if (pthread_join(pl->worker, NULL) != 0) {
+      ERROR("cannot join synthesis thread");
+      ret = -1;
+   }
+
+   const ma_uint32 sr = pl->dev.sampleRate;
+   const long total = pl->total;
+   const struct mix mix = pl->mix;
+   ma_device_uninit(&pl->dev);
+   ma_context_uninit(&pl->ctx);
+   ma_event_uninit(&pl->space);
+   ma_event_uninit(&pl->done);
+   ring_free(&pl->ring);
+   free(pl);
+   cw->player = NULL;
+   if (mix.num > 0)
+      end_voices(mix.voices, mix.num);
+   else
+      end_session(cw);
+
+   if (ret != 0)
+      return -1;
+
+   return (int)((total * 1000LL) / sr);
+}
+
 int cw_play(const char *str, struct cw_data *cw)
 {
-   if (!str || !cw) {
-      ERROR("invalid parameters given");
+   if (cw_play_start(str, cw) != 0)
       return -1;
+
+   return cw_play_wait(cw);
+}
+
+long cw_render(const char *str, struct cw_data *cw, float *buf,
+               size_t max_frames)
+{
+   if (start_session(str, cw) != 0)
+      return -1;
+
+   const long total = count_frames(cw);
+   if (buf) {
+      const size_t n =
+          ((size_t)total < max_frames) ? (size_t)total : max_frames;
+      synth_frames(cw, buf, n);
    }
 
-   if (cw->speed1 <= 0 || cw->speed2 <= 0 || cw->freq <= 0 || cw->amp <= 0) {
+   end_session(cw);
+   return total;
+}
+
+static int put_le(FILE *fp, unsigned long val, int bytes)
+{
+   for (int i = 0; i < bytes; i++) {
+      if (fputc((int)((val >> (8 * i)) & 0xFFUL), fp) == EOF)
+         return -1;
+   }
+   return 0;
+}
+
+static int wav_write_header(FILE *fp, const struct cw_data *fmt,
+                            unsigned long frames)
+{
+   const unsigned long rate = (unsigned long)fmt->sample_rate;
+   const unsigned long ch = (unsigned long)fmt->channels;
+   const unsigned long block = ch * 2UL;
+   const unsigned long data_len = frames * block;
+   const unsigned long riff_len = WAV_HEADER_SIZE + data_len;
+
+   if (fputs("RIFF", fp) == EOF || put_le(fp, riff_len, 4) != 0 ||
+       fputs("WAVEfmt ", fp) == EOF || put_le(fp, 16, 4) != 0 ||
+       put_le(fp, 1, 2) != 0 || put_le(fp, ch, 2) != 0 ||
+       put_le(fp, rate, 4) != 0 || put_le(fp, rate * block, 4) != 0 ||
+       put_le(fp, block, 2) != 0 || put_le(fp, 16, 2) != 0 ||
+       fputs("data", fp) == EOF || put_le(fp, data_len, 4) != 0)
+      return -1;
+
+   return 0;
+}
+
+static int wav_write_frames(FILE *fp, const float *buf, size_t frames,
+                            size_t ch)
+{
+   unsigned char pcm[WAV_CHUNK * MAX_CHANNELS * 2];
+
+   for (size_t i = 0; i < frames * ch; i++) {
+      float x = buf[i];
+      if (x > 1.0F)
+         x = 1.0F;
+      else if (x < -1.0F)
+         x = -1.0F;
+      const long v = lrintf(x * 32767.0F);
+      pcm[2 * i] = (unsigned char)((unsigned long)v & 0xFFUL);
+      pcm[(2 * i) + 1] = (unsigned char)(((unsigned long)v >> 8) & 0xFFUL);
+   }
+
+   if (fwrite(pcm, 2 * ch, frames, fp) != frames)
+      return -1;
+   return 0;
+}
+
+static int wav_stream(FILE *fp, const struct cw_data *fmt, long left,
+                      frame_source src, void *ctx)
+{
+   float buf[WAV_CHUNK * MAX_CHANNELS];
+
+   if (wav_write_header(fp, fmt, (unsigned long)left) != 0)
+      return -1;
+
+   while (left > 0) {
+      const size_t n = (left < WAV_CHUNK) ? (size_t)left : WAV_CHUNK;
+      src(ctx, buf, n);
+      if (wav_write_frames(fp, buf, n, (size_t)fmt->channels) != 0)
+         return -1;
+      left -= (long)n;
+   }
+
+   return 0;
+}
+
+/**
+ * @brief Write a WAV file of the given number of frames taken from src, in
+ * the sample rate and channel count of the session fmt.
+ */
+static int wav_write(const char *path, const struct cw_data *fmt, long frames,
+                     frame_source src, void *ctx)
+{
+   // the sizes in the header are 32-bit fields
+   const unsigned long block = (unsigned long)fmt->channels * 2UL;
+   if ((unsigned long)frames > (WAV_MAX_SIZE - WAV_HEADER_SIZE) / block) {
+      ERROR("%ld frames do not fit in a WAV file", frames);
+      return -1;
+   }
+
+   FILE *fp = fopen(path, "wb");
+   if (!fp) {
+      ERROR("cannot open file '%s'", path);
+      return -1;
+   }
+
+   int ret = wav_stream(fp, fmt, frames, src, ctx);
+   if (ret != 0)
+      ERROR("cannot write to file '%s'", path);
+
+   if (fclose(fp) != 0) {
+      ERROR("failed to close file");
+      ret = -1;
+   }
+
+   return ret;
+}
+
+int cw_render_wav(const char *str, struct cw_data *cw, const char *path)
+{
+   if (!path) {
+      ERROR("no output file given");
+      return -1;
+   }
+
+   if (start_session(str, cw) != 0)
+      return -1;
+
+   const long total = count_frames(cw);
+   const int ret = wav_write(path, cw, total, session_source, cw);
+   end_session(cw);
+
+   if (ret != 0)
+      return -1;
+   return (int)((total * 1000LL) / cw->sample_rate);
+}
+
+/**
+ * @brief Start the sessions of all voices and return the length of the mix in
+ * frames, or -1 on error. All voices must use the same audio format. On
+ * success, end_voices() must be called afterwards.
+ */
+static long start_voices(struct cw_voice *voices, int num)
+{
+   if (!voices || num < 1) {
       ERROR("invalid parameters given");
       return -1;
    }
 
-   if (cw->speed1 < cw->speed2) {
-      ERROR("speed1 must be equal or greater than speed2");
+   long total = 0;
+   for (int v = 0; v < num; v++) {
+      if (start_session(voices[v].text, &voices[v].cw) != 0) {
+         end_voices(voices, v);
+         return -1;
+      }
+
+      if (voices[v].cw.sample_rate != voices[0].cw.sample_rate ||
+          voices[v].cw.channels != voices[0].cw.channels) {
+         ERROR("voices differ in audio format");
+         end_voices(voices, v + 1);
+         return -1;
+      }
+
+      const long frames = count_frames(&voices[v].cw);
+      if (frames > total)
+         total = frames;
+   }
+
+   return total;
+}
+
+long cw_mix(struct cw_voice *voices, int num, float *buf, size_t max_frames)
+{
+   const long total = start_voices(voices, num);
+   if (total < 0)
       return -1;
+
+   if (buf) {
+      const size_t n =
+          ((size_t)total < max_frames) ? (size_t)total : max_frames;
+      mix_frames(voices, num, buf, n);
    }
 
-   char *morse = prepare_morse(str);
-   if (!morse) {
+   end_voices(voices, num);
+   return total;
+}
+
+int cw_mix_wav(struct cw_voice *voices, int num, const char *path)
+{
+   if (!path) {
+      ERROR("no output file given");
       return -1;
    }
 
-   ma_device dev;
+   const long total = start_voices(voices, num);
+   if (total < 0)
+      return -1;
 
-   // Copy morse pointer into the struct for later use
-   cw->morse = morse;
+   struct mix m = {.voices = voices, .num = num};
+   const int ret = wav_write(path, &voices[0].cw, total, mix_source, &m);
+   end_voices(voices, num);
 
-   const int sr = setup_audio_device(cw, &dev);
-   if (sr < 0) {
-      ERROR("audio device setup failed");
-      free(morse);
+   if (ret != 0)
+      return -1;
+   return (int)((total * 1000LL) / voices[0].cw.sample_rate);
+}
+
+int cw_mix_play_start(struct cw_voice *voices, int num)
+{
+   const long total = start_voices(voices, num);
+   if (total < 0)
+      return -1;
+
+   const struct mix m = {.voices = voices, .num = num};
+   if (player_start(&voices[0].cw, &m, total) != 0) {
+      end_voices(voices, num);
       return -1;
    }
 
-   wait_for_playback_to_finish(cw);
+   return 0;
+}
 
-   ma_device_uninit(&dev);
-   free(morse);
+int cw_mix_play(struct cw_voice *voices, int num)
+{
+   if (cw_mix_play_start(voices, num) != 0)
+      return -1;
 
-   return (int)((cw->total_samples * 1000ULL) / sr);
+   return cw_play_wait(&voices[0].cw);
 }
 
 float cw_duration(const char *str, const float speed1, const float speed2)
@@ -315,46 +1042,41 @@ float cw_duration(const char *str, const float speed1, const float speed2)
    if (!str || speed1 <= 0.0F || speed2 <= 0.0F || speed1 < speed2)
       return -1.0F;
 
-   size_t len = strlen(str);
-   char *morse = malloc((len * 10) + 1);
-   if (!morse)
-      return -1.0F;
-
-   ascii_to_morse_expanded(str, morse);
-   const char *p = morse;
+   struct morse_enc enc;
+   morse_enc_init(&enc, str);
 
    float dot_dur = 60.0F / (50.0F * speed1);
    float gap_dur = 60.0F / (50.0F * speed2);
 
    float total = 0.0F;
 
-   while (*p) {
-      switch (*p) {
+   char sym = morse_enc_next(&enc);
+   while (sym) {
+      const char next = morse_enc_next(&enc);
+      switch (sym) {
       case '.':
          total += dot_dur;
-         if (p[1] == '.' || p[1] == '-')
+         if (next == '.' || next == '-')
             total += dot_dur;
          break;
       case '-':
          total += 3 * dot_dur;
-         if (p[1] == '.' || p[1] == '-')
+         if (next == '.' || next == '-')
             total += dot_dur;
          break;
       case '|':
          total += 3 * gap_dur;
          break;
       case '/':
-         if (p[1] != '\0')
+         if (next != '\0')
             total += 7 * gap_dur;
          break;
       default:
-         free(morse);
          return -1.0F;
       }
-      p++;
+      sym = next;
    }
 
-   free(morse);
    return total;
 }
 
@@ -6,44 +6,60 @@
  */
 
 #include "diff.h"
+#include "cpu.h"
 #include "debug.h"
 #include "record.h"
 #include "str.h"
+#include <limits.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-static int **alloc_matrix(size_t rows, size_t cols)
+#ifdef CPU_X86
+#include <immintrin.h>
+#endif
+
+#define DIFF_BLOCK_ROWS 32        // rows traced directly by lev_diff_split()
+#define DIFF_FULL_CELLS (1U << 22) // largest matrix of DIFF_AUTO
+#define DIFF_SMALL_CELLS 4096      // below this, DIFF_AUTO skips the band
+#define DIFF_INF (INT_MAX / 2)     // cost of cells outside a band
+#define DIFF_WORD 64               // cells per bit-parallel operation
+#define DIFF_BAND_MIN 8            // smallest half-width of DIFF_BANDED
+#define DIFF_BAND_DIV 16           // first half-width: 1/16 of the length
+
+/**
+ * @brief Make room for a (rows x cols) matrix in the scratch buffer, which is
+ * only reallocated when it has to grow.
+ */
+static int *ctx_matrix(struct diff_ctx *ctx, size_t rows, size_t cols)
 {
-   int **matrix = (int **)calloc(rows, sizeof(int *));
-   if (!matrix)
+   if (cols != 0 && rows > SIZE_MAX / sizeof(int) / cols) {
+      ERROR("strings too long");
       return NULL;
+   }
 
-   for (size_t i = 0; i < rows; ++i) {
-      matrix[i] = malloc(cols * sizeof(int));
-      if (!matrix[i]) {
-         for (size_t k = 0; k < i; ++k)
-            free(matrix[k]);
-         free((void *)matrix);
+   const size_t cells = rows * cols;
+   if (cells > ctx->cap) {
+      free(ctx->dp); // the old contents are not needed
+      ctx->cap = 0;
+      ctx->dp = malloc(cells * sizeof(int));
+      if (!ctx->dp) {
+         ERROR("out of memory");
          return NULL;
       }
+      ctx->cap = cells;
    }
-   return matrix;
-}
-
-static void free_matrix(int **matrix, size_t rows)
-{
-   for (size_t i = 0; i < rows; ++i)
-      free(matrix[i]);
-   free((void *)matrix);
+   return ctx->dp;
 }
 
-static void init_matrix(int **dp, size_t len1, size_t len2)
+static void init_matrix(int *dp, size_t len1, size_t len2)
 {
+   const size_t cols = len2 + 1;
    for (size_t i = 0; i <= len1; ++i)
-      dp[i][0] = (int)i;
+      dp[i * cols] = (int)i;
    for (size_t j = 0; j <= len2; ++j)
-      dp[0][j] = (int)j;
+      dp[j] = (int)j;
 }
 
 static int compute_min3(int a, int b, int c)
@@ -56,47 +72,719 @@ static int compute_min3(int a, int b, int c)
    return min;
 }
 
-static void fill_matrix(int **dp, const char *s1, const char *s2, size_t len1,
+/**
+ * @brief Compute row i of the matrix, columns 0 to cols - 1, from row i - 1.
+ */
+static void next_row(int *row, const int *up, size_t i, const char *s1,
+                     const char *s2, size_t cols)
+{
+   row[0] = (int)i;
+   for (size_t j = 1; j < cols; ++j) {
+      int cost = (s1[i - 1] == s2[j - 1]) ? 0 : 1;
+      row[j] = compute_min3(up[j] + 1,       // deletion
+                            row[j - 1] + 1,  // insertion
+                            up[j - 1] + cost // substitution
+      );
+   }
+}
+
+static void fill_matrix(int *dp, const char *s1, const char *s2, size_t len1,
                         size_t len2)
 {
+   const size_t cols = len2 + 1;
+   for (size_t i = 1; i <= len1; ++i)
+      next_row(dp + i * cols, dp + (i - 1) * cols, i, s1, s2, cols);
+}
+
+/**
+ * @brief Count an edit against a character; spaces and other characters
+ * without a weight are not tracked.
+ */
+static void count_char(struct record *r, char ch)
+{
+   const int k = str_char_to_int(ch);
+   if (k >= 0)
+      r->weights[k]++;
+}
+
+enum step {
+   STEP_DIAG, // match or substitution
+   STEP_UP,   // deletion, consumes s1
+   STEP_LEFT, // insertion, consumes s2
+};
+
+/**
+ * @brief Choose the step back from cell (i, j) with value here, given its
+ * neighbours diag (i - 1, j - 1), up (i - 1, j) and left (i, j - 1), which
+ * are DIFF_INF when j = 0.
+ *
+ * Of several optimal steps, the diagonal one is taken first, then the one
+ * that consumes s1 (up), or with left_first the one that consumes s2 (left),
+ * which gives the same path on a transposed matrix.
+ */
+static enum step back_step(int here, int diag, int up, int left, int cost,
+                           int left_first)
+{
+   if (here == diag + cost)
+      return STEP_DIAG;
+   if (left_first && here == left + 1)
+      return STEP_LEFT;
+   if (left_first || here == up + 1)
+      return STEP_UP;
+   return STEP_LEFT;
+}
+
+/**
+ * @brief Count the edits of a step back from cell (i, j) and move to the
+ * cell it leads to.
+ */
+static void take_step(struct record *r, enum step step, const char *s1,
+                      const char *s2, size_t *i, size_t *j)
+{
+   switch (step) {
+   case STEP_DIAG:
+      if (s1[*i - 1] != s2[*j - 1]) {
+         count_char(r, s1[*i - 1]);
+         count_char(r, s2[*j - 1]);
+      }
+      --*i;
+      --*j;
+      break;
+   case STEP_UP:
+      count_char(r, s1[*i - 1]);
+      --*i;
+      break;
+   default:
+      count_char(r, s2[*j - 1]);
+      --*j;
+      break;
+   }
+}
+
+/**
+ * @brief Walk the alignment back from cell (i, j) while i > lo, counting the
+ * edits into the record.
+ *
+ * Rows lo to i of the matrix are in dp, stride cells apart. Ties are broken
+ * as in back_step().
+ *
+ * @return Column at which the walk reaches row lo.
+ */
+static size_t trace_back(struct record *r, const int *dp, size_t stride,
+                         const char *s1, const char *s2, size_t lo, size_t i,
+                         size_t j, int left_first)
+{
+   while (i > lo) {
+      const int *row = dp + (i - lo) * stride;
+      const int *up = row - stride;
+      int diag = DIFF_INF;
+      int left = DIFF_INF;
+      int cost = 0;
+      if (j > 0) {
+         diag = up[j - 1];
+         left = row[j - 1];
+         cost = (s1[i - 1] != s2[j - 1]) ? 1 : 0;
+      }
+      const enum step step =
+          back_step(row[j], diag, up[j], left, cost, left_first);
+      take_step(r, step, s1, s2, &i, &j);
+   }
+   return j;
+}
+
+/**
+ * @brief State of a divide-and-conquer traceback.
+ */
+struct split {
+   struct record *r;
+   const char *s1;  // string along the rows
+   const char *s2;  // string along the columns (the shorter one)
+   size_t stride;   // cells per row
+   int *levels;     // one saved row per level of recursion
+   int *roll;       // two rows for computing ahead
+   int *block;      // DIFF_BLOCK_ROWS + 1 rows traced directly
+   int left_first;  // see trace_back()
+};
+
+/**
+ * @brief Trace the alignment from cell (hi, j) back to row lo, given only
+ * row lo of the matrix.
+ *
+ * Short stretches are computed in full and traced directly. Longer ones are
+ * computed ahead to their middle row, which is saved; the lower half is
+ * traced from there, and then the upper half from the column where the path
+ * crossed the middle row. Only columns up to j are ever needed, since the
+ * path never moves right.
+ *
+ * @return Column at which the path reaches row lo.
+ */
+static size_t trace_split(const struct split *sp, const int *top, size_t lo,
+                          size_t hi, size_t j, int level)
+{
+   const size_t cols = j + 1;
+
+   if (hi - lo <= DIFF_BLOCK_ROWS) {
+      int *b = sp->block;
+      memcpy(b, top, cols * sizeof(int));
+      for (size_t i = lo + 1; i <= hi; ++i)
+         next_row(b + (i - lo) * sp->stride, b + (i - lo - 1) * sp->stride, i,
+                  sp->s1, sp->s2, cols);
+      return trace_back(sp->r, b, sp->stride, sp->s1, sp->s2, lo, hi, j,
+                        sp->left_first);
+   }
+
+   const size_t mid = lo + (hi - lo) / 2;
+   int *save = sp->levels + (size_t)level * sp->stride;
+   const int *up = top;
+   for (size_t i = lo + 1; i <= mid; ++i) {
+      int *row = (i == mid) ? save : sp->roll + (i % 2) * sp->stride;
+      next_row(row, up, i, sp->s1, sp->s2, cols);
+      up = row;
+   }
+
+   j = trace_split(sp, save, mid, hi, j, level + 1);
+   return trace_split(sp, top, lo, mid, j, level + 1);
+}
+
+#ifdef CPU_X86
+
+/**
+ * @brief Scalar version of the anti-diagonal kernel below, for the cells
+ * left over after the last full vector.
+ */
+static void diag_scalar(int16_t *out, const int16_t *up, const int16_t *diag,
+                        const char *a, const char *b, size_t n)
+{
+   for (size_t k = 0; k < n; ++k) {
+      const int cost = (a[k] == b[k]) ? 0 : 1;
+      out[k] = (int16_t)compute_min3(up[k] + 1, up[k + 1] + 1, diag[k] + cost);
+   }
+}
+
+/**
+ * @brief Compute n cells of an anti-diagonal, eight at a time.
+ *
+ * Cell k lies below up[k] and right of up[k + 1] on the previous diagonal,
+ * and diagonally from diag[k] two diagonals back; a[k] and b[k] are the
+ * characters it compares.
+ */
+CPU_TARGET("sse2")
+static void diag_sse2(int16_t *out, const int16_t *up, const int16_t *diag,
+                      const char *a, const char *b, size_t n)
+{
+   const __m128i one = _mm_set1_epi16(1);
+   size_t k = 0;
+   for (; k + 8 <= n; k += 8) {
+      const __m128i eq =
+          _mm_cmpeq_epi8(_mm_loadl_epi64((const __m128i *)(a + k)),
+                         _mm_loadl_epi64((const __m128i *)(b + k)));
+      // 0 for a match, 1 otherwise
+      const __m128i cost = _mm_adds_epi16(one, _mm_unpacklo_epi8(eq, eq));
+      const __m128i del = _mm_loadu_si128((const __m128i *)(up + k));
+      const __m128i ins = _mm_loadu_si128((const __m128i *)(up + k + 1));
+      const __m128i sub = _mm_loadu_si128((const __m128i *)(diag + k));
+      __m128i v = _mm_min_epi16(_mm_adds_epi16(del, one),
+                                _mm_adds_epi16(ins, one));
+      v = _mm_min_epi16(v, _mm_adds_epi16(sub, cost));
+      _mm_storeu_si128((__m128i *)(out + k), v);
+   }
+   diag_scalar(out + k, up + k, diag + k, a + k, b + k, n - k);
+}
+
+/**
+ * @brief Compute n cells of an anti-diagonal as diag_sse2(), sixteen at a
+ * time.
+ */
+CPU_TARGET("avx2")
+static void diag_avx2(int16_t *out, const int16_t *up, const int16_t *diag,
+                      const char *a, const char *b, size_t n)
+{
+   const __m256i one = _mm256_set1_epi16(1);
+   size_t k = 0;
+   for (; k + 16 <= n; k += 16) {
+      const __m128i eq =
+          _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(a + k)),
+                         _mm_loadu_si128((const __m128i *)(b + k)));
+      const __m256i cost = _mm256_adds_epi16(one, _mm256_cvtepi8_epi16(eq));
+      const __m256i del = _mm256_loadu_si256((const __m256i *)(up + k));
+      const __m256i ins = _mm256_loadu_si256((const __m256i *)(up + k + 1));
+      const __m256i sub = _mm256_loadu_si256((const __m256i *)(diag + k));
+      __m256i v = _mm256_min_epi16(_mm256_adds_epi16(del, one),
+                                   _mm256_adds_epi16(ins, one));
+      v = _mm256_min_epi16(v, _mm256_adds_epi16(sub, cost));
+      _mm256_storeu_si256((__m256i *)(out + k), v);
+   }
+   diag_sse2(out + k, up + k, diag + k, a + k, b + k, n - k);
+}
+
+typedef void (*diag_fn)(int16_t *out, const int16_t *up, const int16_t *diag,
+                        const char *a, const char *b, size_t n);
+
+/**
+ * @brief Make room for the anti-diagonals of a (len1+1) x (len2+1) matrix,
+ * followed by len2 characters, in the 16-bit scratch buffer.
+ */
+static int16_t *ctx_diagonals(struct diff_ctx *ctx, size_t len1, size_t len2)
+{
+   const size_t cells = (len1 + len2 + 1) * (len1 + 1) + len2 / 2 + 1;
+   if (cells > ctx->cap16) {
+      free(ctx->dp16);
+      ctx->cap16 = 0;
+      ctx->dp16 = malloc(cells * sizeof(int16_t));
+      if (!ctx->dp16) {
+         ERROR("out of memory");
+         return NULL;
+      }
+      ctx->cap16 = cells;
+   }
+   return ctx->dp16;
+}
+
+/**
+ * @brief Fill the matrix one anti-diagonal at a time with a vector kernel,
+ * then trace it as lev_diff_full() does.
+ *
+ * The cells of an anti-diagonal i + j = d depend only on the two before it,
+ * so each diagonal is one run of independent cells. Diagonal d is stored at
+ * row d of a (len1 + len2 + 1) x (len1 + 1) array, indexed by i, so that its
+ * neighbours are at the same or the next lower index of the rows above. The
+ * characters of s2 are compared in reverse, which makes both strings run
+ * forward along a diagonal. Rows run along the shorter string, and every
+ * value fits in 16 bits as long as len1 + len2 < INT16_MAX.
+ */
+static int lev_diff_diag(struct diff_ctx *ctx, struct record *r,
+                         const char *s1, const char *s2, size_t len1,
+                         size_t len2, diag_fn kernel)
+{
+   int left_first = 0;
+   if (len1 > len2) {
+      const char *ts = s1;
+      s1 = s2;
+      s2 = ts;
+      const size_t tl = len1;
+      len1 = len2;
+      len2 = tl;
+      left_first = 1;
+   }
+
+   int16_t *dp = ctx_diagonals(ctx, len1, len2);
+   if (!dp)
+      return -1;
+
+   const size_t w = len1 + 1;
+   const size_t last = len1 + len2;
+   char *rev = (char *)(dp + (last + 1) * w);
+   for (size_t k = 0; k < len2; ++k)
+      rev[k] = s2[len2 - 1 - k];
+
+   for (size_t d = 0; d <= last; ++d) {
+      int16_t *cur = dp + d * w;
+      const size_t ilo = (d > len2) ? d - len2 : 0;
+      const size_t ihi = (d < len1) ? d : len1;
+      if (ilo == 0)
+         cur[0] = (int16_t)d;
+      if (ihi == d)
+         cur[d] = (int16_t)d;
+
+      // cells with i, j >= 1; cell i compares s1[i - 1] with
+      // s2[d - i - 1] = rev[len2 - d + i]
+      const size_t lo = (ilo > 1) ? ilo : 1;
+      const size_t hi = (d > 0 && ihi > d - 1) ? d - 1 : ihi;
+      if (lo <= hi)
+         kernel(cur + lo, cur - w + lo - 1, cur - 2 * w + lo - 1,
+                s1 + lo - 1, rev + (len2 + lo - d), hi - lo + 1);
+   }
+
+   size_t i = len1;
+   size_t j = len2;
+   while (i > 0) {
+      const int16_t *cur = dp + (i + j) * w + i; // cell (i, j)
+      const int16_t *prev = cur - w;             // cell (i, j - 1)
+      int diag = DIFF_INF;
+      int left = DIFF_INF;
+      int cost = 0;
+      if (j > 0) {
+         diag = (prev - w)[-1];
+         left = prev[0];
+         cost = (s1[i - 1] != s2[j - 1]) ? 1 : 0;
+      }
+      const enum step step =
+          back_step(cur[0], diag, prev[-1], left, cost, left_first);
+      take_step(r, step, s1, s2, &i, &j);
+   }
+   for (; j > 0; --j)
+      count_char(r, s2[j - 1]);
+
+   return dp[last * w + len1];
+}
+
+#endif // CPU_X86
+
+static int lev_diff_full(struct diff_ctx *ctx, struct record *r,
+                         const char *s1, const char *s2, size_t len1,
+                         size_t len2)
+{
+#ifdef CPU_X86
+   if (len1 + len2 < INT16_MAX) {
+      switch (cpu_isa()) {
+      case CPU_AVX2:
+         return lev_diff_diag(ctx, r, s1, s2, len1, len2, diag_avx2);
+      case CPU_SSE2:
+         return lev_diff_diag(ctx, r, s1, s2, len1, len2, diag_sse2);
+      default:
+         break;
+      }
+   }
+#endif
+
+   int *dp = ctx_matrix(ctx, len1 + 1, len2 + 1);
+   if (!dp)
+      return -1;
+
+   init_matrix(dp, len1, len2);
+   fill_matrix(dp, s1, s2, len1, len2);
+
+   size_t j = trace_back(r, dp, len2 + 1, s1, s2, 0, len1, len2, 0);
+   for (; j > 0; --j)
+      count_char(r, s2[j - 1]);
+
+   return dp[len1 * (len2 + 1) + len2];
+}
+
+static int lev_diff_split(struct diff_ctx *ctx, struct record *r,
+                          const char *s1, const char *s2, size_t len1,
+                          size_t len2)
+{
+   // keep the rows along the shorter string; the traceback then prefers
+   // the other direction on ties, so the path stays the same
+   struct split sp = {.r = r, .s1 = s1, .s2 = s2};
+   if (len2 > len1) {
+      sp.s1 = s2;
+      sp.s2 = s1;
+      sp.left_first = 1;
+      const size_t t = len1;
+      len1 = len2;
+      len2 = t;
+   }
+   sp.stride = len2 + 1;
+
+   int levels = 0;
+   for (size_t n = len1; n > DIFF_BLOCK_ROWS; n -= n / 2)
+      levels++;
+
+   int *dp = ctx_matrix(ctx, (size_t)levels + DIFF_BLOCK_ROWS + 5, sp.stride);
+   if (!dp)
+      return -1;
+
+   // row 0, the last row (for the distance), then the work rows
+   int *first = dp;
+   int *last = dp + sp.stride;
+   sp.roll = dp + 2 * sp.stride;
+   sp.levels = dp + 4 * sp.stride;
+   sp.block = sp.levels + (size_t)levels * sp.stride;
+
+   for (size_t j = 0; j <= len2; ++j)
+      first[j] = (int)j;
+
+   const int *up = first;
    for (size_t i = 1; i <= len1; ++i) {
-      for (size_t j = 1; j <= len2; ++j) {
+      int *row = (i == len1) ? last : sp.roll + (i % 2) * sp.stride;
+      next_row(row, up, i, sp.s1, sp.s2, sp.stride);
+      up = row;
+   }
+   const int dist = last[len2];
+
+   size_t j = trace_split(&sp, first, 0, len1, len2, 0);
+   for (; j > 0; --j)
+      count_char(r, sp.s2[j - 1]);
+
+   return dist;
+}
+
+/**
+ * @brief Bit-parallel computation of one 64-row block of a DP column.
+ *
+ * Pv and Mv hold the vertical differences (+1 and -1) of the block, eq the
+ * rows whose character matches the current one of the text, and hin the
+ * horizontal difference coming in above the block. Returns the horizontal
+ * difference leaving below it.
+ */
+static int bit_block(uint64_t *pv, uint64_t *mv, uint64_t eq, int hin)
+{
+   const uint64_t high = 1ULL << (DIFF_WORD - 1);
+   const uint64_t hin_neg = (hin < 0) ? 1 : 0;
+   const uint64_t xv = eq | *mv;
+   eq |= hin_neg;
+   const uint64_t xh = (((eq & *pv) + *pv) ^ *pv) | eq;
+   uint64_t ph = *mv | ~(xh | *pv);
+   uint64_t mh = *pv & xh;
+
+   const int hout = ((ph & high) ? 1 : 0) - ((mh & high) ? 1 : 0);
+
+   ph = (ph << 1U) | ((hin > 0) ? 1 : 0);
+   mh = (mh << 1U) | hin_neg;
+   *pv = mh | ~(xv | ph);
+   *mv = ph & xv;
+   return hout;
+}
+
+/**
+ * @brief Levenshtein distance by Myers' bit-vector algorithm, in the blocked
+ * form of Hyyrö, with the pattern p along the bits.
+ */
+static int bit_distance(struct diff_ctx *ctx, const char *p, size_t m,
+                        const char *t, size_t n)
+{
+   if (m == 0 || n == 0)
+      return (int)(m + n);
+
+   // number the characters of the pattern from 1; 0 never matches
+   unsigned char code[UCHAR_MAX + 1] = {0};
+   size_t codes = 1;
+   for (size_t i = 0; i < m; ++i) {
+      const unsigned char c = (unsigned char)p[i];
+      if (code[c] == 0)
+         code[c] = (unsigned char)codes++;
+   }
+
+   const size_t blocks = (m + DIFF_WORD - 1) / DIFF_WORD;
+   const size_t words = (codes + 2) * blocks;
+   if (!ctx->bits || words > ctx->bits_cap) {
+      free(ctx->bits);
+      ctx->bits_cap = 0;
+      ctx->bits = malloc(words * sizeof(uint64_t));
+      if (!ctx->bits) {
+         ERROR("out of memory");
+         return -1;
+      }
+      ctx->bits_cap = words;
+   }
+
+   uint64_t *peq = ctx->bits;
+   uint64_t *pv = peq + codes * blocks;
+   uint64_t *mv = pv + blocks;
+   memset(peq, 0, codes * blocks * sizeof(uint64_t));
+   for (size_t i = 0; i < m; ++i)
+      peq[code[(unsigned char)p[i]] * blocks + i / DIFF_WORD] |=
+          1ULL << (i % DIFF_WORD);
+   for (size_t b = 0; b < blocks; ++b) {
+      pv[b] = ~0ULL; // column 0 counts up by one per row
+      mv[b] = 0;
+   }
+
+   for (size_t j = 0; j < n; ++j) {
+      const uint64_t *eq = peq + code[(unsigned char)t[j]] * blocks;
+      int h = 1; // so does row 0
+      for (size_t b = 0; b < blocks; ++b)
+         h = bit_block(pv + b, mv + b, eq[b], h);
+   }
+
+   // the last column is n at the top, plus its vertical differences
+   long dist = (long)n;
+   for (size_t b = 0; b < blocks; ++b) {
+      uint64_t mask = ~0ULL;
+      if (b == blocks - 1 && m % DIFF_WORD != 0)
+         mask = (1ULL << (m % DIFF_WORD)) - 1;
+      dist += __builtin_popcountll(pv[b] & mask);
+      dist -= __builtin_popcountll(mv[b] & mask);
+   }
+   return (int)dist;
+}
+
+/**
+ * @brief Fill the matrix on the diagonals klo <= j - i <= khi only.
+ *
+ * Each row keeps only its band, plus a cell of DIFF_INF on either side, so
+ * that with a row stride of one less than the stored width the cells of a
+ * diagonal line up, and trace_back() can walk the band like a full matrix.
+ * Cells whose best path leaves the band come out too high, never too low.
+ *
+ * @return Cell (0, 0) of the band, such that cell (i, j) is at
+ * [i * stride + j], or NULL on error.
+ */
+static int *band_fill(struct diff_ctx *ctx, const char *s1, const char *s2,
+                      size_t len1, size_t len2, ptrdiff_t klo, ptrdiff_t khi,
+                      size_t *stride)
+{
+   const size_t w = (size_t)(khi - klo) + 3;
+   int *buf = ctx_matrix(ctx, len1 + 1, w);
+   if (!buf)
+      return NULL;
+   for (size_t c = 0; c < (len1 + 1) * w; ++c)
+      buf[c] = DIFF_INF;
+
+   *stride = w - 1;
+   int *cell0 = buf + (1 - klo);
+
+   for (ptrdiff_t j = 0; j <= khi && j <= (ptrdiff_t)len2; ++j)
+      cell0[j] = (int)j;
+
+   for (size_t i = 1; i <= len1; ++i) {
+      int *row = cell0 + i * *stride;
+      const int *up = row - *stride;
+      const ptrdiff_t lo = (ptrdiff_t)i + klo;
+      const ptrdiff_t hi = (ptrdiff_t)i + khi;
+      size_t j = (lo > 0) ? (size_t)lo : 0;
+      const size_t jhi = (hi < (ptrdiff_t)len2) ? (size_t)hi : len2;
+      if (j == 0)
+         row[j++] = (int)i;
+      for (; j <= jhi; ++j) {
          int cost = (s1[i - 1] == s2[j - 1]) ? 0 : 1;
-         dp[i][j] = compute_min3(dp[i - 1][j] + 1,       // deletion
-                                 dp[i][j - 1] + 1,       // insertion
-                                 dp[i - 1][j - 1] + cost // substitution
+         row[j] = compute_min3(up[j] + 1,       // deletion
+                               row[j - 1] + 1,  // insertion
+                               up[j - 1] + cost // substitution
          );
       }
    }
+
+   return cell0;
 }
 
-static void backtrack_weights(struct record *r, int **dp, const char *s1,
-                              const char *s2, size_t len1, size_t len2)
-{
-   int i = (int)len1;
-   int j = (int)len2;
-
-   while (i > 0 || j > 0) {
-      if (i > 0 && j > 0 &&
-          dp[i][j] == dp[i - 1][j - 1] + ((s1[i - 1] != s2[j - 1]) ? 1 : 0)) {
-         if (s1[i - 1] != s2[j - 1]) {
-            r->weights[str_char_to_int(s1[i - 1])]++;
-            r->weights[str_char_to_int(s2[j - 1])]++;
-         }
-         --i;
-         --j;
-      } else if (i > 0 && dp[i][j] == dp[i - 1][j] + 1) {
-         r->weights[str_char_to_int(s1[i - 1])]++;
-         --i;
-      } else {
-         r->weights[str_char_to_int(s2[j - 1])]++;
-         --j;
-      }
+/**
+ * @brief Trace a band filled by band_fill(), which must contain every cell
+ * of every alignment of the optimal cost; those cells then have their exact
+ * values, and the path is the same as in the full matrix.
+ */
+static int band_trace(struct record *r, const int *cell0, size_t stride,
+                      const char *s1, const char *s2, size_t len1, size_t len2)
+{
+   size_t j = trace_back(r, cell0, stride, s1, s2, 0, len1, len2, 0);
+   for (; j > 0; --j)
+      count_char(r, s2[j - 1]);
+
+   return cell0[len1 * stride + len2];
+}
+
+static int lev_diff_band(struct diff_ctx *ctx, struct record *r,
+                         const char *s1, const char *s2, size_t len1,
+                         size_t len2, ptrdiff_t klo, ptrdiff_t khi)
+{
+   size_t stride = 0;
+   const int *cell0 = band_fill(ctx, s1, s2, len1, len2, klo, khi, &stride);
+   if (!cell0)
+      return -1;
+   return band_trace(r, cell0, stride, s1, s2, len1, len2);
+}
+
+/**
+ * @brief Ukkonen's banded alignment: fill a band of t diagonals either side
+ * of the corner-to-corner ones, and double t until the result is proven.
+ *
+ * A path that leaves the band crosses a diagonal at least |len2 - len1| +
+ * 2t + 2 edits away in total, so a smaller result in the band is optimal.
+ * The first band assumes up to about 1 error in 8 characters.
+ *
+ * @param max_cells Give up, returning -2, rather than fill a band of more
+ * cells than this; 0 for no limit.
+ */
+static int lev_diff_doubling(struct diff_ctx *ctx, struct record *r,
+                             const char *s1, const char *s2, size_t len1,
+                             size_t len2, size_t max_cells)
+{
+   const ptrdiff_t delta = (ptrdiff_t)len2 - (ptrdiff_t)len1;
+   const ptrdiff_t longer = (ptrdiff_t)((len1 > len2) ? len1 : len2);
+   ptrdiff_t t = longer / DIFF_BAND_DIV;
+   if (t < DIFF_BAND_MIN)
+      t = DIFF_BAND_MIN;
+
+   for (;;) {
+      ptrdiff_t klo = ((delta < 0) ? delta : 0) - t;
+      ptrdiff_t khi = ((delta > 0) ? delta : 0) + t;
+      if (klo < -(ptrdiff_t)len1)
+         klo = -(ptrdiff_t)len1;
+      if (khi > (ptrdiff_t)len2)
+         khi = (ptrdiff_t)len2;
+      const int whole = (klo == -(ptrdiff_t)len1 && khi == (ptrdiff_t)len2);
+
+      if (max_cells && (len1 + 1) > max_cells / ((size_t)(khi - klo) + 3))
+         return -2;
+
+      size_t stride = 0;
+      const int *cell0 = band_fill(ctx, s1, s2, len1, len2, klo, khi, &stride);
+      if (!cell0)
+         return -1;
+
+      const ptrdiff_t dist = cell0[len1 * stride + len2];
+      if (whole || dist < (delta < 0 ? -delta : delta) + 2 * t + 2)
+         return band_trace(r, cell0, stride, s1, s2, len1, len2);
+
+      t *= 2;
    }
 }
 
-int lev_diff(struct record *r, const char *s1, const char *s2)
+/**
+ * @brief Diagonals j - i that an alignment of cost dist can touch.
+ *
+ * Reaching diagonal k costs at least |k|, and getting from there to the end
+ * on diagonal len2 - len1 at least |len2 - len1 - k| more.
+ */
+static void band_for(ptrdiff_t dist, size_t len1, size_t len2, ptrdiff_t *klo,
+                     ptrdiff_t *khi)
+{
+   const ptrdiff_t delta = (ptrdiff_t)len2 - (ptrdiff_t)len1;
+   *klo = -((dist - delta) / 2);
+   *khi = (dist + delta) / 2;
+}
+
+static int lev_diff_bits(struct diff_ctx *ctx, struct record *r,
+                         const char *s1, const char *s2, size_t len1,
+                         size_t len2)
+{
+   const int dist = (len1 <= len2) ? bit_distance(ctx, s1, len1, s2, len2)
+                                   : bit_distance(ctx, s2, len2, s1, len1);
+   if (dist < 0)
+      return -1;
+
+   ptrdiff_t klo = 0;
+   ptrdiff_t khi = 0;
+   band_for(dist, len1, len2, &klo, &khi);
+   return lev_diff_band(ctx, r, s1, s2, len1, len2, klo, khi);
+}
+
+void diff_ctx_init(struct diff_ctx *ctx)
+{
+   ctx->dp = NULL;
+   ctx->cap = 0;
+   ctx->bits = NULL;
+   ctx->bits_cap = 0;
+   ctx->dp16 = NULL;
+   ctx->cap16 = 0;
+}
+
+void diff_ctx_free(struct diff_ctx *ctx)
+{
+   free(ctx->dp);
+   free(ctx->bits);
+   free(ctx->dp16);
+   diff_ctx_init(ctx);
+}
+
+int lev_distance(struct diff_ctx *ctx, const char *s1, const char *s2)
 {
+   if (!ctx || !s1 || !s2) {
+      ERROR("invalid parameters given");
+      return -1;
+   }
+
+   const size_t len1 = strlen(s1);
+   const size_t len2 = strlen(s2);
+   if (len1 > INT_MAX || len2 > INT_MAX - len1) {
+      ERROR("strings too long");
+      return -1;
+   }
+
+   return (len1 <= len2) ? bit_distance(ctx, s1, len1, s2, len2)
+                         : bit_distance(ctx, s2, len2, s1, len1);
+}
+
+int lev_diff_mode(struct diff_ctx *ctx, struct record *r, const char *s1,
+                  const char *s2, enum diff_mode mode)
+{
+   if (!ctx || !r || !s1 || !s2) {
+      ERROR("invalid parameters given");
+      return -1;
+   }
+
    size_t len1 = strlen(s1);
    size_t len2 = strlen(s2);
 
@@ -105,16 +793,46 @@ int lev_diff(struct record *r, const char *s1, const char *s2)
       return -1;
    }
 
-   int **dp = alloc_matrix(len1 + 1, len2 + 1);
-   if (!dp)
+   if (mode == DIFF_AUTO) {
+      // small matrices are filled outright; otherwise a band around the
+      // diagonal, unless it grows too wide to keep
+      if ((len1 + 1) <= DIFF_SMALL_CELLS / (len2 + 1))
+         return lev_diff_full(ctx, r, s1, s2, len1, len2);
+
+      const int dist =
+          lev_diff_doubling(ctx, r, s1, s2, len1, len2, DIFF_FULL_CELLS);
+      if (dist != -2)
+         return dist;
+      mode = DIFF_HIRSCHBERG;
+   }
+
+   switch (mode) {
+   case DIFF_FULL:
+      return lev_diff_full(ctx, r, s1, s2, len1, len2);
+   case DIFF_HIRSCHBERG:
+      return lev_diff_split(ctx, r, s1, s2, len1, len2);
+   case DIFF_BITPARALLEL:
+      return lev_diff_bits(ctx, r, s1, s2, len1, len2);
+   case DIFF_BANDED:
+      return lev_diff_doubling(ctx, r, s1, s2, len1, len2, 0);
+   default:
+      ERROR("invalid diff mode %d", (int)mode);
       return -1;
+   }
+}
 
-   init_matrix(dp, len1, len2);
-   fill_matrix(dp, s1, s2, len1, len2);
-   backtrack_weights(r, dp, s1, s2, len1, len2);
+int lev_diff_ctx(struct diff_ctx *ctx, struct record *r, const char *s1,
+                 const char *s2)
+{
+   return lev_diff_mode(ctx, r, s1, s2, DIFF_AUTO);
+}
 
-   int dist = dp[len1][len2];
-   free_matrix(dp, len1 + 1);
+int lev_diff(struct record *r, const char *s1, const char *s2)
+{
+   struct diff_ctx ctx;
+   diff_ctx_init(&ctx);
+   const int dist = lev_diff_ctx(&ctx, r, s1, s2);
+   diff_ctx_free(&ctx);
    return dist;
 }
 
@@ -5,16 +5,61 @@
  * @author Jakob Kastelic
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include "gen.h"
+#include "alias.h"
+#include "arena.h"
 #include "debug.h"
+#include "rng.h"
 #include "str.h"
-#include "xorshift32.h"
+#include <ctype.h>
+#include <fcntl.h>
 #include <limits.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <time.h>
+#include <unistd.h>
+
+#define GEN_DRAWS 256
+#define GEN_CHUNK 65536 // target characters per streamed chunk
+#define GEN_MAX_THREADS 64
+#define GEN_OUT_BUF 65536 // bytes collected per fwrite() of write_words()
+#define MARKOV_SYMS 43     // supported characters, plus the word boundary
+#define MARKOV_END (MARKOV_SYMS - 1)
+
+/**
+ * @brief Random numbers generated in bulk and handed out one at a time.
+ */
+struct draws {
+   struct rng_lanes lanes;
+   uint32_t buf[GEN_DRAWS];
+   size_t pos;
+};
+
+/**
+ * @brief Split fresh lanes off rng; a fixed cost of RNG_LANES jumps per call
+ * of the bulk generators, see rng_lanes_init().
+ */
+static void draws_init(struct draws *d, struct rng *rng)
+{
+   rng_lanes_init(&d->lanes, rng);
+   d->pos = GEN_DRAWS;
+}
+
+static uint32_t draws_next(struct draws *d)
+{
+   if (d->pos == GEN_DRAWS) {
+      rng_fill_u32(&d->lanes, d->buf, GEN_DRAWS);
+      d->pos = 0;
+   }
+   return d->buf[d->pos++];
+}
 
 static int check_max_limit(const char *name, int val)
 {
@@ -51,168 +96,421 @@ static int validate_params(const size_t num_char, int min_word, int max_word)
    return 0;
 }
 
-static int validate_charset_weights(const float *weights, const char *charset,
-                                    float **out_tmp_weights, float *out_sum)
+/**
+ * @brief Look up the weight of every charset character.
+ */
+static int charset_weights(float *w, const float *weights, const char *charset,
+                           int len)
 {
-   size_t charset_len = strlen(charset);
-   float *tmp_weights = malloc(sizeof(float) * charset_len);
-   if (!tmp_weights) {
-      ERROR("cannot allocate temp weights array");
-      return -1;
-   }
-
-   float sum = 0.0F;
-   for (size_t j = 0; j < charset_len; j++) {
-      char ch = charset[j];
-      int k = str_char_to_int(ch);
+   for (int j = 0; j < len; j++) {
+      const char ch = charset[j];
+      const int k = str_char_to_int(ch);
       if (k < 0) {
          ERROR("character '%c' (ASCII %d) is invalid", ch == '\0' ? ' ' : ch,
                ch);
-         free(tmp_weights);
          return -1;
       }
-      float w = weights[k];
-      tmp_weights[j] = w;
-      sum += w;
+      w[j] = weights ? weights[k] : 1.0F;
+   }
+   return 0;
+}
+
+int gen_sampler_init(struct gen_sampler *gs, const float *weights,
+                     const char *charset)
+{
+   const char *default_charset = "kmuresnaptlwi.jz=foy,vg5/q92h38b?47c1d60x";
+   if (!gs) {
+      ERROR("invalid parameters given");
+      return -1;
+   }
+   if (!charset)
+      charset = default_charset;
+
+   if (str_is_clean(charset) != 0) {
+      ERROR("charset contains unsupported characters");
+      return -1;
+   }
+
+   const size_t len = strlen(charset);
+   if (len == 0) {
+      ERROR("empty charset");
+      return -1;
+   }
+   if (len > INT_MAX) {
+      ERROR("charset too long");
+      return -1;
    }
 
-   if (sum == 0.0F) {
-      ERROR("weights sum to zero");
-      free(tmp_weights);
+   gs->len = (int)len;
+   gs->charset = str_dup(charset);
+   float *w = malloc(sizeof(float) * len);
+   if (!gs->charset || !w) {
+      ERROR("out of memory");
+      free(gs->charset);
+      free(w);
       return -1;
    }
 
-   *out_tmp_weights = tmp_weights;
-   *out_sum = sum;
+   if (charset_weights(w, weights, charset, gs->len) != 0 ||
+       alias_init(&gs->table, w, gs->len) != 0) {
+      free(gs->charset);
+      free(w);
+      return -1;
+   }
+
+   free(w);
    return 0;
 }
 
-static int allocate_and_fill_cdf(float **cdf, const float *tmp_weights,
-                                 size_t charset_len, float sum)
+void gen_sampler_free(struct gen_sampler *gs)
+{
+   alias_free(&gs->table);
+   free(gs->charset);
+   gs->charset = NULL;
+   gs->len = 0;
+}
+
+int gen_chars_sampler(char *s, const size_t num_char, const int min_word,
+                      const int max_word, const struct gen_sampler *gs,
+                      struct rng *rng)
 {
-   *cdf = malloc(sizeof(float) * charset_len);
-   if (!*cdf) {
-      ERROR("cannot allocate cdf");
+   if (validate_params(num_char, min_word, max_word) != 0)
+      return -1;
+
+   if (!s || !gs || !gs->charset) {
+      ERROR("invalid parameters given");
       return -1;
    }
 
-   float accum = 0.0F;
-   for (size_t j = 0; j < charset_len; j++) {
-      accum += tmp_weights[j];
-      (*cdf)[j] = accum / sum;
+   if (!rng)
+      rng = rng_default();
+
+   struct draws d;
+   draws_init(&d, rng);
+   const uint64_t range = (uint64_t)(max_word - min_word + 1);
+   size_t written = 0;
+
+   while (written < num_char - 1) {
+      int wlen = min_word + (int)((draws_next(&d) * range) >> 32U);
+      if (wlen > (int)(num_char - 1 - written))
+         wlen = (int)(num_char - 1 - written);
+
+      for (int i = 0; i < wlen && written < num_char - 2; i++)
+         s[written++] = gs->charset[alias_pick(&gs->table, draws_next(&d))];
+
+      if (written < num_char - 2)
+         s[written++] = ' ';
+      else
+         break;
    }
+
+   s[written] = '\0';
    return 0;
 }
 
-static int prepare_cdf(float **cdf, const float *weights, const char *charset)
+int gen_chars(char *s, const size_t num_char, const int min_word,
+              const int max_word, const float *weights, const char *charset,
+              struct rng *rng)
 {
-   float *tmp_weights = NULL;
-   float sum = 0.0F;
-
-   if (validate_charset_weights(weights, charset, &tmp_weights, &sum) != 0)
+   if (validate_params(num_char, min_word, max_word) != 0)
       return -1;
 
-   size_t charset_len = strlen(charset);
-   if (allocate_and_fill_cdf(cdf, tmp_weights, charset_len, sum) != 0) {
-      free(tmp_weights);
+   struct gen_sampler gs;
+   if (gen_sampler_init(&gs, weights, charset) != 0)
       return -1;
+
+   const int ret = gen_chars_sampler(s, num_char, min_word, max_word, &gs, rng);
+   gen_sampler_free(&gs);
+   return ret;
+}
+
+enum slot_state {
+   SLOT_FREE,  // may be claimed for the next chunk
+   SLOT_BUSY,  // chunk being generated
+   SLOT_READY, // chunk waiting to be emitted
+};
+
+struct stream_slot {
+   char *buf;             // chunk target + max_word + 1 characters
+   size_t target;         // generate whole words up to at least this length
+   size_t len;            // characters generated
+   struct rng stream;     // random stream owned by this chunk
+   enum slot_state state; // guarded by the pool lock
+};
+
+/**
+ * @brief Chunks of gen_stream() in flight: workers generate them into a ring
+ * of slots, and the calling thread emits them in order.
+ */
+struct stream_pool {
+   const struct gen_sampler *gs; // characters to draw from
+   int min_word;                 // minimum word length
+   int max_word;                 // maximum word length
+   size_t num_char;              // characters to emit
+   struct rng *rng;              // one long jump per chunk claimed
+   size_t planned;               // characters of all chunks claimed so far
+   size_t next;                  // index of the next chunk to claim
+   struct stream_slot *slots;    // chunk k goes into slot k % num_slots
+   int num_slots;                // two per worker, so writing overlaps
+   int stop;                     // set when no more chunks are wanted
+   pthread_mutex_t lock;         // guards the fields above and slot states
+   pthread_cond_t cond;          // any slot changed state
+};
+
+/**
+ * @brief Claim the next chunk, waiting until its slot has been emitted.
+ *
+ * Chunks are claimed in order, so chunk k always gets the stream k long
+ * jumps into rng and covers the same characters, whatever the number of
+ * threads. Each holds GEN_CHUNK characters, or what remains.
+ *
+ * @return The slot of the chunk, or NULL once all chunks are claimed.
+ */
+static struct stream_slot *pool_claim(struct stream_pool *p)
+{
+   struct stream_slot *slot = NULL;
+
+   pthread_mutex_lock(&p->lock);
+   while (!p->stop && p->planned < p->num_char &&
+          p->slots[p->next % (size_t)p->num_slots].state != SLOT_FREE)
+      pthread_cond_wait(&p->cond, &p->lock);
+
+   if (!p->stop && p->planned < p->num_char) {
+      slot = &p->slots[p->next % (size_t)p->num_slots];
+      const size_t left = p->num_char - p->planned;
+      slot->target = (left < GEN_CHUNK) ? left : GEN_CHUNK;
+      slot->stream = *p->rng;
+      slot->state = SLOT_BUSY;
+      rng_long_jump(p->rng);
+      p->planned += slot->target;
+      p->next++;
    }
+   pthread_mutex_unlock(&p->lock);
 
-   free(tmp_weights);
-   return 0;
+   return slot;
 }
 
 /**
- * @brief Pick a random character from charset uniformly.
+ * @brief Generate whole space-terminated words until a claimed chunk holds
+ * at least its target number of characters, and mark it ready.
  */
-static char pick_random_char(const char *charset)
+static void pool_fill(struct stream_pool *p, struct stream_slot *slot)
 {
-   size_t charset_len = strlen(charset);
-   if (charset_len > INT_MAX) {
-      ERROR("charset too long");
-      return -1;
+   const struct gen_sampler *gs = p->gs;
+   const uint64_t range = (uint64_t)(p->max_word - p->min_word + 1);
+   struct draws d;
+   size_t len = 0;
+
+   draws_init(&d, &slot->stream);
+   while (len < slot->target) {
+      const int wlen = p->min_word + (int)((draws_next(&d) * range) >> 32U);
+      for (int i = 0; i < wlen; i++)
+         slot->buf[len++] = gs->charset[alias_pick(&gs->table, draws_next(&d))];
+      slot->buf[len++] = ' ';
    }
+   slot->len = len;
+
+   pthread_mutex_lock(&p->lock);
+   slot->state = SLOT_READY;
+   pthread_cond_broadcast(&p->cond);
+   pthread_mutex_unlock(&p->lock);
+}
+
+static void *pool_worker(void *arg)
+{
+   struct stream_pool *p = (struct stream_pool *)arg;
+   struct stream_slot *slot = NULL;
+   while ((slot = pool_claim(p)) != NULL)
+      pool_fill(p, slot);
+   return NULL;
+}
 
-   int idx = (int)(xorshift32_rand_float() * (float)charset_len);
+static void pool_set_state(struct stream_pool *p, struct stream_slot *slot,
+                           enum slot_state state)
+{
+   pthread_mutex_lock(&p->lock);
+   slot->state = state;
+   pthread_cond_broadcast(&p->cond);
+   pthread_mutex_unlock(&p->lock);
+}
 
-   if (idx >= (int)charset_len)
-      idx = (int)charset_len - 1;
-   return charset[idx];
+static void pool_stop(struct stream_pool *p)
+{
+   pthread_mutex_lock(&p->lock);
+   p->stop = 1;
+   pthread_cond_broadcast(&p->cond);
+   pthread_mutex_unlock(&p->lock);
 }
 
 /**
- * @brief Pick a weighted random character from charset using cdf.
+ * @brief Pass the chunks to the sink in order as they become ready, until
+ * num_char characters are emitted. With no workers, each chunk is generated
+ * here just before it is emitted.
  */
-static char pick_weighted_char(const char *charset, const float *cdf)
-{
-   size_t charset_len = strlen(charset);
-   float r = xorshift32_rand_float();
-   size_t lo = 0;
-   size_t hi = charset_len - 1;
-   while (lo < hi) {
-      size_t mid = (lo + hi) / 2;
-      if (cdf[mid] < r)
-         lo = mid + 1;
-      else
-         hi = mid;
+static int pool_emit(struct stream_pool *p, gen_sink sink, void *ctx,
+                     int workers)
+{
+   size_t emitted = 0;
+
+   for (size_t k = 0; emitted < p->num_char; k++) {
+      struct stream_slot *slot = &p->slots[k % (size_t)p->num_slots];
+
+      if (workers == 0) {
+         struct stream_slot *mine = pool_claim(p);
+         if (mine)
+            pool_fill(p, mine);
+      }
+
+      pthread_mutex_lock(&p->lock);
+      while (slot->state != SLOT_READY)
+         pthread_cond_wait(&p->cond, &p->lock);
+      pthread_mutex_unlock(&p->lock);
+
+      size_t n = slot->len;
+      if (n > p->num_char - emitted)
+         n = p->num_char - emitted;
+      if (sink(ctx, slot->buf, n) != 0) {
+         ERROR("cannot emit generated text");
+         return -1;
+      }
+      emitted += n;
+
+      pool_set_state(p, slot, SLOT_FREE);
    }
-   return charset[lo];
+
+   return 0;
 }
 
-int gen_chars(char *s, const size_t num_char, const int min_word,
-              const int max_word, const float *weights, const char *charset)
+/**
+ * @brief Run the workers of a pool whose slots are allocated, and emit the
+ * text from the calling thread.
+ */
+static int pool_run(struct stream_pool *p, gen_sink sink, void *ctx,
+                    int threads)
 {
-   if (validate_params(num_char, min_word, max_word) != 0)
-      return -1;
+   pthread_t tid[GEN_MAX_THREADS];
+   int started = 0;
+   int ret = 0;
+
+   // a single thread generates and emits in turn
+   if (threads > 1) {
+      for (; started < threads; started++) {
+         if (pthread_create(&tid[started], NULL, pool_worker, p) != 0) {
+            ERROR("cannot start generator thread");
+            ret = -1;
+            break;
+         }
+      }
+   }
 
-   const char *default_charset = "kmuresnaptlwi.jz=foy,vg5/q92h38b?47c1d60x";
-   if (!charset)
-      charset = default_charset;
+   if (ret == 0)
+      ret = pool_emit(p, sink, ctx, started);
 
-   if (str_is_clean(charset) != 0) {
-      ERROR("charset contains unsupported characters");
+   pool_stop(p);
+   for (int t = 0; t < started; t++)
+      pthread_join(tid[t], NULL);
+
+   return ret;
+}
+
+static int stream_threads(int threads)
+{
+   if (threads <= 0) {
+      const long n = sysconf(_SC_NPROCESSORS_ONLN);
+      threads = (n > 0) ? (int)n : 1;
+   }
+   return (threads > GEN_MAX_THREADS) ? GEN_MAX_THREADS : threads;
+}
+
+int gen_stream(gen_sink sink, void *ctx, const size_t num_char,
+               const int min_word, const int max_word, const float *weights,
+               const char *charset, int threads, struct rng *rng)
+{
+   if (!sink) {
+      ERROR("no sink given");
       return -1;
    }
+   if (min_word < 1 || max_word < min_word) {
+      ERROR("invalid word size range: min=%d, max=%d", min_word, max_word);
+      return -1;
+   }
+   if (check_max_limit("max word", max_word) != 0)
+      return -1;
 
-   size_t charset_len = strlen(charset);
-   if (charset_len == 0) {
-      ERROR("empty charset");
+   if (!rng)
+      rng = rng_default();
+   threads = stream_threads(threads);
+
+   struct stream_pool p = {.min_word = min_word,
+                           .max_word = max_word,
+                           .num_char = num_char,
+                           .rng = rng,
+                           .num_slots = (threads > 1) ? 2 * threads : 1};
+   struct stream_slot slots[2 * GEN_MAX_THREADS] = {{0}};
+   struct gen_sampler gs;
+   if (gen_sampler_init(&gs, weights, charset) != 0)
       return -1;
+   p.gs = &gs;
+   p.slots = slots;
+
+   // a chunk never holds more than the whole session
+   const size_t chunk = (num_char < GEN_CHUNK) ? num_char : GEN_CHUNK;
+   const size_t cap = chunk + (size_t)max_word + 1;
+   int ret = 0;
+   for (int k = 0; k < p.num_slots && ret == 0; k++) {
+      slots[k].buf = malloc(cap);
+      if (!slots[k].buf) {
+         ERROR("out of memory");
+         ret = -1;
+      }
    }
 
-   float *cdf = NULL;
-   if (weights) {
-      if (prepare_cdf(&cdf, weights, charset) != 0)
-         return -1;
+   if (ret == 0) {
+      pthread_mutex_init(&p.lock, NULL);
+      pthread_cond_init(&p.cond, NULL);
+      ret = pool_run(&p, sink, ctx, threads);
+      pthread_cond_destroy(&p.cond);
+      pthread_mutex_destroy(&p.lock);
    }
 
-   size_t written = 0;
+   for (int k = 0; k < p.num_slots; k++)
+      free(slots[k].buf);
+   gen_sampler_free(&gs);
+   return ret;
+}
 
-   while (written < num_char - 1) {
-      const int range = max_word - min_word + 1;
-      int wlen = min_word + (int)(xorshift32_rand_float() * (float)range);
-      if (wlen > (int)(num_char - 1 - written))
-         wlen = (int)(num_char - 1 - written);
+int gen_sink_file(void *ctx, const char *buf, size_t len)
+{
+   return (fwrite(buf, 1, len, (FILE *)ctx) == len) ? 0 : -1;
+}
 
-      for (int i = 0; i < wlen && written < num_char - 2; i++) {
-         if (!weights) {
-            s[written++] = pick_random_char(charset);
-         } else {
-            s[written++] = pick_weighted_char(charset, cdf);
-         }
+int gen_corpus(const char *out_file, const size_t num_char, const int min_word,
+               const int max_word, const float *weights, const char *charset,
+               int threads, struct rng *rng)
+{
+   FILE *out = stdout;
+   if (out_file) {
+      out = fopen(out_file, "w");
+      if (!out) {
+         ERROR("could not open output file");
+         return -1;
       }
-
-      if (written < num_char - 2)
-         s[written++] = ' ';
-      else
-         break;
    }
 
-   s[written] = '\0';
+   int ret = gen_stream(gen_sink_file, out, num_char, min_word, max_word,
+                        weights, charset, threads, rng);
 
-   free(cdf);
+   if (ret == 0 && fputc('\n', out) == EOF) {
+      ERROR("cannot write output");
+      ret = -1;
+   }
 
-   return 0;
+   if (out_file && fclose(out) != 0) {
+      ERROR("failed to close file");
+      ret = -1;
+   }
+
+   return ret;
 }
 
 void free_entries(struct WordEntry *entries, int count)
@@ -233,9 +531,12 @@ float compute_total_weight(struct WordEntry *entries, int count)
 }
 
 const char *select_random_word(struct WordEntry *entries, int count,
-                               float total_weight)
+                               float total_weight, struct rng *rng)
 {
-   float r = xorshift32_rand_float() *
+   if (!rng)
+      rng = rng_default();
+
+   float r = rng_float(rng) *
              (total_weight > 0.0F ? total_weight : (float)count);
    float accum = 0.0F;
    for (int i = 0; i < count; ++i) {
@@ -248,26 +549,185 @@ const char *select_random_word(struct WordEntry *entries, int count,
    return entries[count - 1].word; // fallback
 }
 
-int write_words(FILE *out, struct WordEntry *entries, int count, int nw,
-                float total_weight)
+int word_sampler_init(struct word_sampler *ws, const struct WordEntry *entries,
+                      int count, float total_weight)
 {
-   for (int i = 0; i < nw; ++i) {
-      const char *word = select_random_word(entries, count, total_weight);
-      if (fprintf(out, "%s", word) < 0)
-         return -1;
+   if (!ws || !entries || count < 1) {
+      ERROR("invalid parameters given");
+      return -1;
+   }
 
-      if (i < nw - 1) {
-         if (fprintf(out, " ") < 0)
-            return -1;
+   const size_t n = (size_t)count;
+   float *w = malloc(sizeof(float) * n);
+   if (!w) {
+      ERROR("out of memory");
+      return -1;
+   }
+
+   const char **words = malloc(n * sizeof(char *));
+   size_t *lens = malloc(n * sizeof(size_t));
+   if (!words || !lens) {
+      ERROR("out of memory");
+      free(w);
+      free(words);
+      free(lens);
+      return -1;
+   }
+
+   for (int i = 0; i < count; ++i) {
+      w[i] = (total_weight > 0.0F) ? entries[i].weight : 1.0F;
+      words[i] = entries[i].word;
+      lens[i] = strlen(entries[i].word);
+   }
+
+   const int ret = alias_init(&ws->table, w, count);
+   free(w);
+   if (ret != 0) {
+      free(words);
+      free(lens);
+      return -1;
+   }
+
+   ws->words = words;
+   ws->lens = lens;
+   ws->count = count;
+   ws->owned = 1;
+   return 0;
+}
+
+int word_sampler_init_dict(struct word_sampler *ws, const struct word_dict *wd)
+{
+   if (!ws || !wd || wd->count < 1) {
+      ERROR("invalid parameters given");
+      return -1;
+   }
+
+   if (wd->total_weight > 0.0F) {
+      if (alias_init(&ws->table, wd->weights, wd->count) != 0)
+         return -1;
+   } else {
+      float *w = malloc(sizeof(float) * (size_t)wd->count);
+      if (!w) {
+         ERROR("out of memory");
+         return -1;
       }
+      for (int i = 0; i < wd->count; ++i)
+         w[i] = 1.0F;
+      const int ret = alias_init(&ws->table, w, wd->count);
+      free(w);
+      if (ret != 0)
+         return -1;
+   }
+
+   ws->words = (const char *const *)wd->words;
+   ws->lens = wd->lens;
+   ws->count = wd->count;
+   ws->owned = 0;
+   return 0;
+}
+
+void word_sampler_free(struct word_sampler *ws)
+{
+   alias_free(&ws->table);
+   if (ws->owned) {
+      free((void *)ws->words);
+      free((void *)ws->lens);
    }
+   ws->words = NULL;
+   ws->lens = NULL;
+   ws->count = 0;
+   ws->owned = 0;
+}
+
+const char *word_sampler_pick(const struct word_sampler *ws, struct rng *rng,
+                              size_t *len)
+{
+   if (!rng)
+      rng = rng_default();
+
+   const int k = alias_pick(&ws->table, rng_next(rng));
+   if (len)
+      *len = ws->lens[k];
+   return ws->words[k];
+}
+
+/**
+ * @brief Output builder: collects text in a large block and writes it out with
+ * a single fwrite() whenever the block is full.
+ */
+struct out_buf {
+   FILE *fp;
+   size_t len;
+   char buf[GEN_OUT_BUF];
+};
 
-   if (fprintf(out, "\n") < 0)
+static int out_flush(struct out_buf *ob)
+{
+   if (ob->len > 0 && fwrite(ob->buf, 1, ob->len, ob->fp) != ob->len)
       return -1;
+   ob->len = 0;
+   return 0;
+}
 
+static int out_put(struct out_buf *ob, const char *s, size_t n)
+{
+   if (ob->len + n > GEN_OUT_BUF) {
+      if (out_flush(ob) != 0)
+         return -1;
+      if (n > GEN_OUT_BUF)
+         return (fwrite(s, 1, n, ob->fp) == n) ? 0 : -1;
+   }
+   memcpy(ob->buf + ob->len, s, n);
+   ob->len += n;
    return 0;
 }
 
+int write_words_sampler(FILE *out, const struct word_sampler *ws, int nw,
+                        struct rng *rng)
+{
+   if (!rng)
+      rng = rng_default();
+
+   struct out_buf *ob = malloc(sizeof(struct out_buf));
+   if (!ob) {
+      ERROR("out of memory");
+      return -1;
+   }
+   ob->fp = out;
+   ob->len = 0;
+
+   struct draws d;
+   draws_init(&d, rng);
+
+   int ret = 0;
+   for (int i = 0; i < nw && ret == 0; ++i) {
+      const int k = alias_pick(&ws->table, draws_next(&d));
+      ret = out_put(ob, ws->words[k], ws->lens[k]);
+      if (ret == 0)
+         ret = out_put(ob, (i < nw - 1) ? " " : "\n", 1);
+   }
+   if (nw <= 0 && ret == 0)
+      ret = out_put(ob, "\n", 1);
+
+   if (ret == 0)
+      ret = out_flush(ob);
+
+   free(ob);
+   return ret;
+}
+
+int write_words(FILE *out, struct WordEntry *entries, int count, int nw,
+                float total_weight, struct rng *rng)
+{
+   struct word_sampler ws;
+   if (word_sampler_init(&ws, entries, count, total_weight) != 0)
+      return -1;
+
+   const int ret = write_words_sampler(out, &ws, nw, rng);
+   word_sampler_free(&ws);
+   return ret;
+}
+
 int is_line_too_long(FILE *fp, char *line)
 {
    // if no newline in buffer and not EOF, line too long
@@ -286,15 +746,18 @@ int validate_word(const char *word)
    return 0;
 }
 
-int parse_line(const char *line, char **word_out, float *weight_out,
-               int *has_weight_out)
+/**
+ * @brief Split a line in place into its word and optional weight.
+ *
+ * Same contract as parse_line(), except that the returned word points into
+ * the (modified) line instead of a fresh copy.
+ */
+static int split_line(char *line, char **word_out, float *weight_out,
+                      int *has_weight_out)
 {
-   char linecopy[MAX_WORD_LINE];
-   strncpy(linecopy, line, sizeof(linecopy) - 1);
-   linecopy[sizeof(linecopy) - 1] = '\0';
-
-   char *word = strtok(linecopy, " ");
-   char *weight_str = strtok(NULL, " ");
+   char *save = NULL;
+   char *word = strtok_r(line, " ", &save);
+   char *weight_str = strtok_r(NULL, " ", &save);
 
    if (!word) {
       ERROR("empty line");
@@ -324,6 +787,21 @@ int parse_line(const char *line, char **word_out, float *weight_out,
       *weight_out = 0.0F;
    }
 
+   *word_out = word;
+   return 0;
+}
+
+int parse_line(const char *line, char **word_out, float *weight_out,
+               int *has_weight_out)
+{
+   char linecopy[MAX_WORD_LINE];
+   strncpy(linecopy, line, sizeof(linecopy) - 1);
+   linecopy[sizeof(linecopy) - 1] = '\0';
+
+   char *word = NULL;
+   if (split_line(linecopy, &word, weight_out, has_weight_out) < 0)
+      return -1;
+
    *word_out = str_dup(word);
    if (!*word_out) {
       ERROR("memory allocation failed");
@@ -333,28 +811,14 @@ int parse_line(const char *line, char **word_out, float *weight_out,
    return 0;
 }
 
-int parse_word_file(const char *word_file, struct WordEntry **entries_out,
-                    int nl)
+/**
+ * @brief Parse word entries from an open stream, as parse_word_file().
+ */
+static int parse_word_stream(FILE *fp, struct WordEntry **entries_out, int nl)
 {
-   FILE *fp = stdin;
-   if (word_file) {
-      fp = fopen(word_file, "r");
-      if (!fp) {
-         ERROR("could not open word file");
-         return -1;
-      }
-   }
-
-   struct WordEntry *entries = NULL;
    int capacity = (nl > 0) ? nl : 16; // start small and grow
-   entries = calloc(capacity, sizeof(struct WordEntry));
+   struct WordEntry *entries = calloc(capacity, sizeof(struct WordEntry));
    if (!entries) {
-      if (word_file) {
-         if (fclose(fp) != 0) {
-            ERROR("failed to close file");
-            return -1;
-         }
-      }
       ERROR("memory allocation failed");
       return -1;
    }
@@ -381,6 +845,7 @@ int parse_word_file(const char *word_file, struct WordEntry **entries_out,
 
       if (validate_word(word)) {
          ERROR("invalid character in word");
+         free(word);
          goto fail;
       }
 
@@ -390,33 +855,21 @@ int parse_word_file(const char *word_file, struct WordEntry **entries_out,
              realloc(entries, capacity * sizeof(struct WordEntry));
          if (!new_entries) {
             ERROR("memory reallocation failed");
+            free(word);
             goto fail;
          }
          entries = new_entries;
       }
 
-      entries[count].word = str_dup(word);
-      if (!entries[count].word) {
-         ERROR("memory allocation failed for word");
-         goto fail;
-      }
+      // parse_line() already made a copy; the entry takes ownership of it
+      entries[count].word = word;
       entries[count].weight = weight;
       count++;
    }
 
-   if (word_file) {
-      if (fclose(fp) != 0) {
-         ERROR("failed to close file");
-         free_entries(entries, count);
-         return -1;
-      }
-   }
-
    if (nl > 0 && count < nl) {
       ERROR("not enough lines in file");
-      free_entries(entries, count);
-      *entries_out = NULL;
-      return -1;
+      goto fail;
    }
 
    *entries_out = entries;
@@ -425,40 +878,299 @@ int parse_word_file(const char *word_file, struct WordEntry **entries_out,
 fail:
    free_entries(entries, count);
    *entries_out = NULL;
+   return -1;
+}
+
+int parse_word_file(const char *word_file, struct WordEntry **entries_out,
+                    int nl)
+{
+   FILE *fp = stdin;
+   if (word_file) {
+      fp = fopen(word_file, "r");
+      if (!fp) {
+         ERROR("could not open word file");
+         return -1;
+      }
+   }
+
+   const int count = parse_word_stream(fp, entries_out, nl);
+
    if (word_file) {
       if (fclose(fp) != 0) {
          ERROR("failed to close file");
+         if (count >= 0) {
+            free_entries(*entries_out, count);
+            *entries_out = NULL;
+         }
          return -1;
       }
    }
+
+   return count;
+}
+
+/**
+ * @brief Unmap a word file and free its entries.
+ */
+static void unmap_words(struct word_map *wm)
+{
+   if (wm->map && munmap((void *)wm->map, wm->size) != 0)
+      ERROR("failed to unmap word file");
+   free_entries(wm->entries, wm->count);
+   *wm = (struct word_map){0};
+}
+
+/**
+ * @brief Set up the arena of a dictionary for n words and text bytes of
+ * copied words, and empty it.
+ * @return The space for the copied words, or NULL on error.
+ */
+static char *dict_alloc(struct word_dict *wd, size_t n, size_t text)
+{
+   // size the arena for everything, so that it all lands in a single block
+   arena_init(&wd->arena, text + n * (sizeof(char *) + sizeof(size_t) +
+                                      sizeof(float)) + 64);
+
+   wd->words = arena_alloc(&wd->arena, n * sizeof(char *));
+   wd->lens = arena_alloc(&wd->arena, n * sizeof(size_t));
+   wd->weights = arena_alloc(&wd->arena, n * sizeof(float));
+   char *p = arena_alloc(&wd->arena, text);
+   if (!wd->words || !wd->lens || !wd->weights || !p) {
+      word_dict_free(wd);
+      return NULL;
+   }
+
+   wd->count = 0;
+   wd->total_weight = 0.0F;
+   return p;
+}
+
+static void dict_add(struct word_dict *wd, const char *word, size_t len,
+                     float weight)
+{
+   wd->words[wd->count] = word;
+   wd->lens[wd->count] = len;
+   wd->weights[wd->count] = weight;
+   wd->total_weight += weight;
+   wd->count++;
+}
+
+/**
+ * @brief Load a dictionary from a stream; the entries are kept in wd->src.
+ */
+static int stream_words(struct word_dict *wd, FILE *fp, int nl)
+{
+   const int count = parse_word_stream(fp, &wd->src.entries, nl);
+   if (count < 0) {
+      wd->src = (struct word_map){0};
+      return -1;
+   }
+   wd->src.count = count;
+
+   if (!dict_alloc(wd, (size_t)count, 0))
+      return -1;
+   for (int i = 0; i < count; ++i) {
+      const struct WordEntry *e = &wd->src.entries[i];
+      dict_add(wd, e->word, strlen(e->word), e->weight);
+   }
+   return count;
+}
+
+/**
+ * @brief Load a dictionary from a regular file of the given size.
+ *
+ * The file is mapped read-only and kept in wd->src. Each line is parsed from
+ * a copy in a line buffer, as parse_word_file() does, and the word is then
+ * located in the mapping, so that the words are views into the file. Closes
+ * fd.
+ */
+static int map_words(struct word_dict *wd, int fd, size_t size, int nl)
+{
+   const char *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+   if (close(fd) != 0)
+      ERROR("failed to close file");
+   if (map == MAP_FAILED) {
+      ERROR("could not map word file");
+      return -1;
+   }
+   wd->src.map = map;
+   wd->src.size = size;
+
+   // count the lines up front so that the arrays are allocated once
+   size_t lines = (map[size - 1] != '\n') ? 1 : 0;
+   for (const char *p = map; (p = memchr(p, '\n', size - (size_t)(p - map)));
+        ++p)
+      lines++;
+   if (nl > 0 && lines > (size_t)nl)
+      lines = (size_t)nl;
+   if (lines > INT_MAX) {
+      ERROR("too many lines in word file");
+      unmap_words(&wd->src);
+      return -1;
+   }
+
+   if (!dict_alloc(wd, lines, 0))
+      return -1;
+
+   int has_weight = -1;
+   size_t pos = 0;
+   while (pos < size && (nl <= 0 || wd->count < nl)) {
+      const char *line = map + pos;
+      const char *end = memchr(line, '\n', size - pos);
+
+      // the longest line parse_word_file() can read into its buffer
+      const size_t len = end ? (size_t)(end - line) : size - pos;
+      if (len > MAX_WORD_LINE - 2) {
+         ERROR("line too long");
+         goto fail;
+      }
+      pos += len + 1;
+
+      char buf[MAX_WORD_LINE];
+      memcpy(buf, line, len);
+      buf[len] = '\0';
+      buf[strcspn(buf, "\r")] = '\0';
+
+      char *word = NULL;
+      float weight = 0.0F;
+      if (split_line(buf, &word, &weight, &has_weight) < 0)
+         goto fail;
+
+      if (validate_word(word)) {
+         ERROR("invalid character in word");
+         goto fail;
+      }
+
+      dict_add(wd, line + (word - buf), strlen(word), weight);
+   }
+
+   if (nl > 0 && wd->count < nl) {
+      ERROR("not enough lines in file");
+      goto fail;
+   }
+
+   return wd->count;
+
+fail:
+   word_dict_free(wd);
    return -1;
 }
 
+int word_dict_init(struct word_dict *wd, const struct WordEntry *entries,
+                   int count)
+{
+   if (!wd || !entries || count < 0) {
+      ERROR("invalid parameters given");
+      return -1;
+   }
+   wd->src = (struct word_map){0};
+
+   size_t text = 0;
+   for (int i = 0; i < count; ++i)
+      text += strlen(entries[i].word) + 1;
+
+   char *p = dict_alloc(wd, (size_t)count, text);
+   if (!p)
+      return -1;
+
+   for (int i = 0; i < count; ++i) {
+      const size_t len = strlen(entries[i].word);
+      memcpy(p, entries[i].word, len + 1);
+      dict_add(wd, p, len, entries[i].weight);
+      p += len + 1;
+   }
+
+   return 0;
+}
+
+int word_dict_load(struct word_dict *wd, const char *word_file, int nl)
+{
+   if (!wd) {
+      ERROR("invalid parameters given");
+      return -1;
+   }
+   wd->src = (struct word_map){0};
+
+   if (!word_file)
+      return stream_words(wd, stdin, nl);
+
+   const int fd = open(word_file, O_RDONLY);
+   if (fd < 0) {
+      ERROR("could not open word file");
+      return -1;
+   }
+
+   struct stat st;
+   if (fstat(fd, &st) != 0) {
+      ERROR("word file unreadable");
+      if (close(fd) != 0)
+         ERROR("failed to close file");
+      return -1;
+   }
+
+   if (S_ISREG(st.st_mode) && st.st_size > 0)
+      return map_words(wd, fd, (size_t)st.st_size, nl);
+
+   // pipes, FIFOs and empty files cannot be mapped: read them as a stream
+   FILE *fp = fdopen(fd, "r");
+   if (!fp) {
+      ERROR("could not open word file");
+      if (close(fd) != 0)
+         ERROR("failed to close file");
+      return -1;
+   }
+   const int count = stream_words(wd, fp, nl);
+   if (fclose(fp) != 0) {
+      ERROR("failed to close file");
+      if (count >= 0)
+         word_dict_free(wd);
+      return -1;
+   }
+   return count;
+}
+
+void word_dict_free(struct word_dict *wd)
+{
+   arena_free(&wd->arena);
+   unmap_words(&wd->src);
+   wd->words = NULL;
+   wd->lens = NULL;
+   wd->weights = NULL;
+   wd->count = 0;
+   wd->total_weight = 0.0F;
+}
+
 int gen_words(const char *out_file, const char *word_file, const int nw,
-              const int nl)
+              const int nl, struct rng *rng)
 {
-   struct WordEntry *entries = NULL;
-   int count = parse_word_file(word_file, &entries, nl);
-   if (count < 0) {
+   struct word_dict wd;
+   if (word_dict_load(&wd, word_file, nl) < 0) {
       ERROR("could not parse file");
       return -1;
    }
 
-   float total_weight = compute_total_weight(entries, count);
+   // index the dictionary once, so that each word costs O(1)
+   struct word_sampler ws;
+   if (word_sampler_init_dict(&ws, &wd) != 0) {
+      word_dict_free(&wd);
+      return -1;
+   }
 
    FILE *out = stdout;
    if (out_file) {
       out = fopen(out_file, "w");
       if (!out) {
          ERROR("could not open output file");
-         free_entries(entries, count);
+         word_sampler_free(&ws);
+         word_dict_free(&wd);
          return -1;
       }
    }
 
-   int status = write_words(out, entries, count, nw, total_weight);
+   int status = write_words_sampler(out, &ws, nw, rng);
 
-   free_entries(entries, count);
+   word_sampler_free(&ws);
+   word_dict_free(&wd);
 
    if (out_file) {
       if (fclose(out) != 0) {
@@ -470,4 +1182,388 @@ int gen_words(const char *out_file, const char *word_file, const int nw,
    return status;
 }
 
+/**
+ * @brief Transition counts gathered during training.
+ */
+struct markov_counts {
+   uint64_t *keys; // context * MARKOV_SYMS + symbol, plus one (0 = empty)
+   float *counts;  // weight of every transition
+   size_t cap;     // number of slots, a power of two
+   size_t used;    // number of occupied slots
+   uint32_t span;  // number of possible contexts
+};
+
+struct markov_pair {
+   uint64_t key;
+   float count;
+};
+
+static size_t hash_slot(uint64_t key, size_t mask)
+{
+   return (size_t)((key * 0x9E3779B97F4A7C15ULL) >> 32U) & mask;
+}
+
+static int counts_init(struct markov_counts *c, int order, size_t cap)
+{
+   if (order < 1 || order > MARKOV_MAX_ORDER) {
+      ERROR("Markov order must be from 1 to %d", MARKOV_MAX_ORDER);
+      return -1;
+   }
+
+   c->span = 1;
+   for (int i = 0; i < order; i++)
+      c->span *= MARKOV_SYMS;
+
+   c->cap = cap;
+   c->used = 0;
+   c->keys = calloc(cap, sizeof(uint64_t));
+   c->counts = calloc(cap, sizeof(float));
+   if (!c->keys || !c->counts) {
+      ERROR("out of memory");
+      free(c->keys);
+      free(c->counts);
+      return -1;
+   }
+   return 0;
+}
+
+static void counts_free(struct markov_counts *c)
+{
+   free(c->keys);
+   free(c->counts);
+   c->keys = NULL;
+   c->counts = NULL;
+}
+
+static int counts_add(struct markov_counts *c, uint64_t key, float w)
+{
+   // keep the table at most half full
+   if (2 * (c->used + 1) > c->cap) {
+      struct markov_counts g = *c;
+      g.cap = 2 * c->cap;
+      g.used = c->used;
+      g.keys = calloc(g.cap, sizeof(uint64_t));
+      g.counts = calloc(g.cap, sizeof(float));
+      if (!g.keys || !g.counts) {
+         ERROR("out of memory");
+         free(g.keys);
+         free(g.counts);
+         return -1;
+      }
+      for (size_t i = 0; i < c->cap; i++) {
+         if (c->keys[i] == 0)
+            continue;
+         size_t j = hash_slot(c->keys[i], g.cap - 1);
+         while (g.keys[j] != 0)
+            j = (j + 1) & (g.cap - 1);
+         g.keys[j] = c->keys[i];
+         g.counts[j] = c->counts[i];
+      }
+      counts_free(c);
+      *c = g;
+   }
+
+   size_t i = hash_slot(key + 1, c->cap - 1);
+   while (c->keys[i] != 0 && c->keys[i] != key + 1)
+      i = (i + 1) & (c->cap - 1);
+   if (c->keys[i] == 0) {
+      c->keys[i] = key + 1;
+      c->counts[i] = 0.0F;
+      c->used++;
+   }
+   c->counts[i] += w;
+   return 0;
+}
+
+/**
+ * @brief Count the transitions of one word, from the start-of-word context
+ * through to the end of the word.
+ */
+static int counts_word(struct markov_counts *c, const char *word, size_t len,
+                       float w)
+{
+   uint32_t ctx = c->span - 1; // all symbols are MARKOV_END
+   for (size_t i = 0; i < len; i++) {
+      const int sym = str_char_to_int((char)tolower((unsigned char)word[i]));
+      if (sym < 0) {
+         ERROR("invalid character in word");
+         return -1;
+      }
+      if (counts_add(c, (uint64_t)ctx * MARKOV_SYMS + (uint64_t)sym, w) != 0)
+         return -1;
+      ctx = (ctx * MARKOV_SYMS + (uint32_t)sym) % c->span;
+   }
+   return counts_add(c, (uint64_t)ctx * MARKOV_SYMS + MARKOV_END, w);
+}
+
+static int compare_pairs(const void *a, const void *b)
+{
+   const uint64_t ka = ((const struct markov_pair *)a)->key;
+   const uint64_t kb = ((const struct markov_pair *)b)->key;
+   return (ka > kb) - (ka < kb);
+}
+
+static int markov_state(const struct markov *m, uint32_t ctx)
+{
+   if (!m->keys)
+      return m->index[ctx];
+
+   for (size_t i = hash_slot(ctx + 1, m->mask);; i = (i + 1) & m->mask) {
+      if (m->keys[i] == 0)
+         return -1;
+      if (m->keys[i] == ctx + 1)
+         return m->index[i];
+   }
+}
+
+/**
+ * @brief Lay out the model: states, per-state alias tables and the context
+ * index, all in one arena.
+ */
+static int markov_layout(struct markov *m, const struct markov_pair *pairs,
+                         size_t num_pairs, const float *weights)
+{
+   int states = 0;
+   for (size_t i = 0; i < num_pairs; i++)
+      states += (i == 0 || pairs[i].key / MARKOV_SYMS !=
+                               pairs[i - 1].key / MARKOV_SYMS);
+
+   // dense index for short contexts, open-addressing hash for long ones
+   size_t slots = m->span;
+   if (m->order > 2) {
+      slots = 1;
+      while (slots < 2 * (size_t)states)
+         slots *= 2;
+   }
+
+   const size_t ns = (size_t)states;
+   arena_init(&m->arena, (ns + 1) * sizeof(int) + ns * sizeof(uint32_t) +
+                             num_pairs * (1 + sizeof(uint32_t) + sizeof(int)) +
+                             slots * (sizeof(uint32_t) + sizeof(int)) + 128);
+   m->first = arena_alloc(&m->arena, (ns + 1) * sizeof(int));
+   m->end = arena_alloc(&m->arena, ns * sizeof(uint32_t));
+   m->sym = arena_alloc(&m->arena, num_pairs);
+   m->threshold = arena_alloc(&m->arena, num_pairs * sizeof(uint32_t));
+   m->alias = arena_alloc(&m->arena, num_pairs * sizeof(int));
+   m->index = arena_alloc(&m->arena, slots * sizeof(int));
+   m->keys = NULL;
+   if (m->order > 2) {
+      m->keys = arena_alloc(&m->arena, slots * sizeof(uint32_t));
+      if (m->keys)
+         memset(m->keys, 0, slots * sizeof(uint32_t));
+   }
+   if (!m->first || !m->end || !m->sym || !m->threshold || !m->alias ||
+       !m->index || (m->order > 2 && !m->keys))
+      return -1;
+   for (size_t i = 0; i < slots; i++)
+      m->index[i] = -1;
+   m->mask = slots - 1;
+
+   float uni[MARKOV_SYMS] = {0};
+   int t = 0;
+   int st = 0;
+   for (size_t i = 0; i < num_pairs; st++) {
+      const uint32_t ctx = (uint32_t)(pairs[i].key / MARKOV_SYMS);
+      float w[MARKOV_SYMS];
+      float sum = 0.0F;
+      float end = 0.0F;
+      int n = 0;
+
+      m->first[st] = t;
+      for (; i < num_pairs && pairs[i].key / MARKOV_SYMS == ctx; i++) {
+         const int sym = (int)(pairs[i].key % MARKOV_SYMS);
+         if (sym == MARKOV_END) {
+            end = pairs[i].count;
+            continue;
+         }
+         const float x = pairs[i].count * (weights ? weights[sym] : 1.0F);
+         if (x > 0.0F) {
+            m->sym[t + n] = (unsigned char)sym;
+            w[n++] = x;
+            sum += x;
+            uni[sym] += x;
+         }
+      }
+
+      const double p_end =
+          (sum > 0.0F) ? (double)end / ((double)end + (double)sum) : 1.0;
+      m->end[st] =
+          (p_end >= 1.0) ? UINT32_MAX : (uint32_t)(p_end * 4294967296.0);
+
+      if (n > 0) {
+         struct alias a;
+         if (alias_init(&a, w, n) != 0)
+            return -1;
+         memcpy(m->threshold + t, a.threshold, (size_t)n * sizeof(uint32_t));
+         memcpy(m->alias + t, a.alias, (size_t)n * sizeof(int));
+         alias_free(&a);
+         t += n;
+      }
+
+      if (m->keys) {
+         size_t k = hash_slot(ctx + 1, m->mask);
+         while (m->keys[k] != 0)
+            k = (k + 1) & m->mask;
+         m->keys[k] = ctx + 1;
+         m->index[k] = st;
+      } else {
+         m->index[ctx] = st;
+      }
+   }
+   m->first[st] = t;
+   m->states = states;
+
+   return alias_init(&m->unigram, uni, MARKOV_END);
+}
+
+static int markov_finish(struct markov *m, struct markov_counts *c,
+                         int order, const float *weights)
+{
+   struct markov_pair *pairs = malloc(c->used * sizeof(struct markov_pair));
+   if (!pairs) {
+      ERROR("out of memory");
+      counts_free(c);
+      return -1;
+   }
+
+   // sorting groups the transitions of every context together
+   size_t n = 0;
+   for (size_t i = 0; i < c->cap; i++) {
+      if (c->keys[i] != 0) {
+         pairs[n].key = c->keys[i] - 1;
+         pairs[n].count = c->counts[i];
+         n++;
+      }
+   }
+   counts_free(c);
+   qsort(pairs, n, sizeof(struct markov_pair), compare_pairs);
+
+   *m = (struct markov){0};
+   m->order = order;
+   m->span = c->span;
+   const int ret = markov_layout(m, pairs, n, weights);
+   free(pairs);
+   if (ret != 0) {
+      ERROR("could not build Markov model");
+      markov_free(m);
+   }
+   return ret;
+}
+
+int markov_train(struct markov *m, int order, const struct word_dict *wd,
+                 const float *weights)
+{
+   if (!m || !wd || wd->count < 1) {
+      ERROR("invalid parameters given");
+      return -1;
+   }
+
+   struct markov_counts c;
+   if (counts_init(&c, order, 1024) != 0)
+      return -1;
+
+   for (int i = 0; i < wd->count; i++) {
+      const float w = (wd->total_weight > 0.0F) ? wd->weights[i] : 1.0F;
+      if (w > 0.0F && counts_word(&c, wd->words[i], wd->lens[i], w) != 0) {
+         counts_free(&c);
+         return -1;
+      }
+   }
+
+   return markov_finish(m, &c, order, weights);
+}
+
+int markov_train_text(struct markov *m, int order, const char *text,
+                      const float *weights)
+{
+   if (!m || !text) {
+      ERROR("invalid parameters given");
+      return -1;
+   }
+
+   struct markov_counts c;
+   if (counts_init(&c, order, 1024) != 0)
+      return -1;
+
+   for (const char *p = text; *p;) {
+      size_t len = 0;
+      while (p[len] &&
+             str_char_to_int((char)tolower((unsigned char)p[len])) >= 0)
+         len++;
+      if (len > 0 && counts_word(&c, p, len, 1.0F) != 0) {
+         counts_free(&c);
+         return -1;
+      }
+      p += len;
+      if (*p)
+         p++; // separator
+   }
+
+   if (c.used == 0) {
+      ERROR("no words in training text");
+      counts_free(&c);
+      return -1;
+   }
+
+   return markov_finish(m, &c, order, weights);
+}
+
+void markov_free(struct markov *m)
+{
+   alias_free(&m->unigram);
+   arena_free(&m->arena);
+   *m = (struct markov){0};
+}
+
+int markov_gen(const struct markov *m, char *s, const size_t num_char,
+               const int min_word, const int max_word, struct rng *rng)
+{
+   if (validate_params(num_char, min_word, max_word) != 0)
+      return -1;
+
+   if (!m || !s || !m->first) {
+      ERROR("invalid parameters given");
+      return -1;
+   }
+
+   if (!rng)
+      rng = rng_default();
+
+   struct draws d;
+   draws_init(&d, rng);
+   const size_t limit = num_char - 1;
+   size_t written = 0;
+
+   while (written < limit) {
+      if (written > 0) {
+         if (written + 1 >= limit)
+            break;
+         s[written++] = ' ';
+      }
+
+      uint32_t ctx = m->span - 1;
+      for (int len = 0; len < max_word && written < limit; len++) {
+         const int st = markov_state(m, ctx);
+         if (len >= min_word && (st < 0 || draws_next(&d) < m->end[st]))
+            break;
+
+         int sym = 0;
+         if (st >= 0 && m->first[st] < m->first[st + 1]) {
+            const int f = m->first[st];
+            const struct alias a = {m->first[st + 1] - f, m->threshold + f,
+                                    m->alias + f};
+            sym = m->sym[f + alias_pick(&a, draws_next(&d))];
+         } else {
+            sym = alias_pick(&m->unigram, draws_next(&d));
+         }
+
+         s[written++] = str_int_to_char(sym);
+         ctx = (ctx * MARKOV_SYMS + (uint32_t)sym) % m->span;
+      }
+   }
+
+   s[written] = '\0';
+   return 0;
+}
+
 // end file gen.c
@@ -0,0 +1,88 @@
+/**
+ * @file ring.c
+ * @brief Lock-free single-producer/single-consumer ring buffer of samples.
+ *
+ * @author Jakob Kastelic
+ */
+
+#include "ring.h"
+#include "debug.h"
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+int ring_init(struct ring *r, size_t size)
+{
+   size_t cap = 1;
+   while (cap < size)
+      cap <<= 1U;
+
+   r->buf = malloc(sizeof(float) * cap);
+   if (!r->buf) {
+      ERROR("out of memory");
+      return -1;
+   }
+
+   r->size = cap;
+   atomic_init(&r->head, 0);
+   atomic_init(&r->tail, 0);
+   return 0;
+}
+
+void ring_free(struct ring *r)
+{
+   free(r->buf);
+   r->buf = NULL;
+   r->size = 0;
+}
+
+size_t ring_readable(struct ring *r)
+{
+   const size_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+   const size_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+   return head - tail;
+}
+
+size_t ring_writable(struct ring *r)
+{
+   return r->size - ring_readable(r);
+}
+
+size_t ring_write(struct ring *r, const float *src, size_t n)
+{
+   const size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+   const size_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+
+   const size_t space = r->size - (head - tail);
+   if (n > space)
+      n = space;
+
+   // copy in up to two pieces, around the end of the storage
+   const size_t start = head & (r->size - 1);
+   const size_t first = (n < r->size - start) ? n : r->size - start;
+   memcpy(r->buf + start, src, sizeof(float) * first);
+   memcpy(r->buf, src + first, sizeof(float) * (n - first));
+
+   atomic_store_explicit(&r->head, head + n, memory_order_release);
+   return n;
+}
+
+size_t ring_read(struct ring *r, float *dst, size_t n)
+{
+   const size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+   const size_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+
+   const size_t avail = head - tail;
+   if (n > avail)
+      n = avail;
+
+   const size_t start = tail & (r->size - 1);
+   const size_t first = (n < r->size - start) ? n : r->size - start;
+   memcpy(dst, r->buf + start, sizeof(float) * first);
+   memcpy(dst + first, r->buf, sizeof(float) * (n - first));
+
+   atomic_store_explicit(&r->tail, tail + n, memory_order_release);
+   return n;
+}
+
+// end file ring.c
@@ -0,0 +1,370 @@
+/**
+ * @file rng.c
+ * @brief xoshiro128** pseudorandom number generator with explicit state.
+ *
+ * The generator and its jump polynomial are by David Blackman and Sebastiano
+ * Vigna (https://prng.di.unimi.it/).
+ *
+ * @author Jakob Kastelic
+ */
+
+#include "rng.h"
+#include "cpu.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#ifdef CPU_X86
+#include <immintrin.h>
+#endif
+
+#define RNG_BLOCK 256 // values converted per pass, a multiple of RNG_LANES
+
+static uint64_t splitmix64(uint64_t *x)
+{
+   uint64_t z = (*x += 0x9E3779B97F4A7C15ULL);
+   z = (z ^ (z >> 30U)) * 0xBF58476D1CE4E5B9ULL;
+   z = (z ^ (z >> 27U)) * 0x94D049BB133111EBULL;
+   return z ^ (z >> 31U);
+}
+
+void rng_seed(struct rng *r, uint64_t seed)
+{
+   const uint64_t a = splitmix64(&seed);
+   const uint64_t b = splitmix64(&seed);
+
+   r->s[0] = (uint32_t)a;
+   r->s[1] = (uint32_t)(a >> 32U);
+   r->s[2] = (uint32_t)b;
+   r->s[3] = (uint32_t)(b >> 32U);
+
+   // the all-zero state is a fixed point
+   if ((r->s[0] | r->s[1] | r->s[2] | r->s[3]) == 0)
+      r->s[0] = 1;
+}
+
+static void jump_poly(struct rng *r, const uint32_t *poly)
+{
+   uint32_t t[4] = {0, 0, 0, 0};
+
+   for (int i = 0; i < 4; i++) {
+      for (unsigned int b = 0; b < 32; b++) {
+         if (poly[i] & (1UL << b)) {
+            for (int k = 0; k < 4; k++)
+               t[k] ^= r->s[k];
+         }
+         rng_next(r);
+      }
+   }
+
+   for (int k = 0; k < 4; k++)
+      r->s[k] = t[k];
+}
+
+void rng_jump(struct rng *r)
+{
+   static const uint32_t jump[] = {0x8764000b, 0xf542d2d3, 0x6fa035c3,
+                                   0x77f2db5b};
+   jump_poly(r, jump);
+}
+
+void rng_long_jump(struct rng *r)
+{
+   static const uint32_t long_jump[] = {0xb523952e, 0x0b6f099f, 0xccf5a0ef,
+                                        0x1c580662};
+   jump_poly(r, long_jump);
+}
+
+void rng_split(struct rng *r, struct rng *child)
+{
+   *child = *r;
+   rng_jump(r);
+}
+
+struct rng *rng_default(void)
+{
+   static struct rng def;
+   static int seeded = 0;
+
+   if (!seeded) {
+      // auto-seed on first call using time and address entropy
+      const uint64_t addr = (uint64_t)(uintptr_t)&def;
+      rng_seed(&def, ((uint64_t)time(NULL) << 32U) ^ addr);
+      seeded = 1;
+   }
+
+   return &def;
+}
+
+void rng_lanes_init(struct rng_lanes *l, struct rng *r)
+{
+   for (int j = 0; j < RNG_LANES; j++) {
+      struct rng lane;
+      rng_split(r, &lane);
+      for (int k = 0; k < 4; k++)
+         l->s[k][j] = lane.s[k];
+   }
+}
+
+/**
+ * @brief Advance all lanes by steps and store RNG_LANES outputs per step.
+ */
+static void lanes_scalar(struct rng_lanes *l, uint32_t *out, size_t steps)
+{
+   for (size_t i = 0; i < steps; i++) {
+      for (int j = 0; j < RNG_LANES; j++) {
+         struct rng lane = {{l->s[0][j], l->s[1][j], l->s[2][j], l->s[3][j]}};
+         out[(i * RNG_LANES) + j] = rng_next(&lane);
+         for (int k = 0; k < 4; k++)
+            l->s[k][j] = lane.s[k];
+      }
+   }
+}
+
+static void to_float_scalar(const uint32_t *x, float *out, size_t n)
+{
+   for (size_t i = 0; i < n; i++)
+      out[i] = (float)(x[i] >> 8U) * (1.0F / 16777216.0F);
+}
+
+static void to_below_scalar(uint32_t *x, size_t n, uint32_t range)
+{
+   for (size_t i = 0; i < n; i++)
+      x[i] = (uint32_t)(((uint64_t)x[i] * range) >> 32U);
+}
+
+#ifdef CPU_X86
+
+CPU_TARGET("sse2")
+static inline __m128i rotl_sse2(__m128i x, int k)
+{
+   return _mm_or_si128(_mm_slli_epi32(x, k), _mm_srli_epi32(x, 32 - k));
+}
+
+/**
+ * @brief One xoshiro128** step of four lanes; multiplications by 5 and 9 are
+ * done with shifts, as SSE2 lacks a 32-bit multiply.
+ */
+CPU_TARGET("sse2")
+static inline __m128i step_sse2(__m128i *s0, __m128i *s1, __m128i *s2,
+                                __m128i *s3)
+{
+   const __m128i x5 = _mm_add_epi32(_mm_slli_epi32(*s1, 2), *s1);
+   const __m128i r = rotl_sse2(x5, 7);
+   const __m128i result = _mm_add_epi32(_mm_slli_epi32(r, 3), r);
+   const __m128i t = _mm_slli_epi32(*s1, 9);
+
+   *s2 = _mm_xor_si128(*s2, *s0);
+   *s3 = _mm_xor_si128(*s3, *s1);
+   *s1 = _mm_xor_si128(*s1, *s2);
+   *s0 = _mm_xor_si128(*s0, *s3);
+   *s2 = _mm_xor_si128(*s2, t);
+   *s3 = rotl_sse2(*s3, 11);
+
+   return result;
+}
+
+CPU_TARGET("sse2")
+static void lanes_sse2(struct rng_lanes *l, uint32_t *out, size_t steps)
+{
+   for (int h = 0; h < RNG_LANES; h += 4) {
+      __m128i s0 = _mm_loadu_si128((const __m128i *)&l->s[0][h]);
+      __m128i s1 = _mm_loadu_si128((const __m128i *)&l->s[1][h]);
+      __m128i s2 = _mm_loadu_si128((const __m128i *)&l->s[2][h]);
+      __m128i s3 = _mm_loadu_si128((const __m128i *)&l->s[3][h]);
+
+      for (size_t i = 0; i < steps; i++)
+         _mm_storeu_si128((__m128i *)&out[(i * RNG_LANES) + h],
+                          step_sse2(&s0, &s1, &s2, &s3));
+
+      _mm_storeu_si128((__m128i *)&l->s[0][h], s0);
+      _mm_storeu_si128((__m128i *)&l->s[1][h], s1);
+      _mm_storeu_si128((__m128i *)&l->s[2][h], s2);
+      _mm_storeu_si128((__m128i *)&l->s[3][h], s3);
+   }
+}
+
+CPU_TARGET("sse2")
+static void to_float_sse2(const uint32_t *x, float *out, size_t n)
+{
+   const __m128 scale = _mm_set1_ps(1.0F / 16777216.0F);
+   size_t i = 0;
+   for (; i + 4 <= n; i += 4) {
+      const __m128i v = _mm_loadu_si128((const __m128i *)&x[i]);
+      const __m128 f = _mm_cvtepi32_ps(_mm_srli_epi32(v, 8));
+      _mm_storeu_ps(&out[i], _mm_mul_ps(f, scale));
+   }
+   to_float_scalar(x + i, out + i, n - i);
+}
+
+CPU_TARGET("sse2")
+static void to_below_sse2(uint32_t *x, size_t n, uint32_t range)
+{
+   const __m128i r = _mm_set1_epi32((int)range);
+   const __m128i odd_mask = _mm_set_epi32(-1, 0, -1, 0);
+   size_t i = 0;
+   for (; i + 4 <= n; i += 4) {
+      const __m128i v = _mm_loadu_si128((const __m128i *)&x[i]);
+      const __m128i even = _mm_srli_epi64(_mm_mul_epu32(v, r), 32);
+      const __m128i odd = _mm_mul_epu32(_mm_srli_epi64(v, 32), r);
+      _mm_storeu_si128((__m128i *)&x[i],
+                       _mm_or_si128(even, _mm_and_si128(odd, odd_mask)));
+   }
+   to_below_scalar(x + i, n - i, range);
+}
+
+CPU_TARGET("avx2")
+static inline __m256i rotl_avx2(__m256i x, int k)
+{
+   return _mm256_or_si256(_mm256_slli_epi32(x, k),
+                          _mm256_srli_epi32(x, 32 - k));
+}
+
+CPU_TARGET("avx2")
+static void lanes_avx2(struct rng_lanes *l, uint32_t *out, size_t steps)
+{
+   __m256i s0 = _mm256_loadu_si256((const __m256i *)l->s[0]);
+   __m256i s1 = _mm256_loadu_si256((const __m256i *)l->s[1]);
+   __m256i s2 = _mm256_loadu_si256((const __m256i *)l->s[2]);
+   __m256i s3 = _mm256_loadu_si256((const __m256i *)l->s[3]);
+   const __m256i five = _mm256_set1_epi32(5);
+   const __m256i nine = _mm256_set1_epi32(9);
+
+   for (size_t i = 0; i < steps; i++) {
+      const __m256i r = rotl_avx2(_mm256_mullo_epi32(s1, five), 7);
+      const __m256i t = _mm256_slli_epi32(s1, 9);
+      _mm256_storeu_si256((__m256i *)&out[i * RNG_LANES],
+                          _mm256_mullo_epi32(r, nine));
+
+      s2 = _mm256_xor_si256(s2, s0);
+      s3 = _mm256_xor_si256(s3, s1);
+      s1 = _mm256_xor_si256(s1, s2);
+      s0 = _mm256_xor_si256(s0, s3);
+      s2 = _mm256_xor_si256(s2, t);
+      s3 = rotl_avx2(s3, 11);
+   }
+
+   _mm256_storeu_si256((__m256i *)l->s[0], s0);
+   _mm256_storeu_si256((__m256i *)l->s[1], s1);
+   _mm256_storeu_si256((__m256i *)l->s[2], s2);
+   _mm256_storeu_si256((__m256i *)l->s[3], s3);
+}
+
+CPU_TARGET("avx2")
+static void to_float_avx2(const uint32_t *x, float *out, size_t n)
+{
+   const __m256 scale = _mm256_set1_ps(1.0F / 16777216.0F);
+   size_t i = 0;
+   for (; i + 8 <= n; i += 8) {
+      const __m256i v = _mm256_loadu_si256((const __m256i *)&x[i]);
+      const __m256 f = _mm256_cvtepi32_ps(_mm256_srli_epi32(v, 8));
+      _mm256_storeu_ps(&out[i], _mm256_mul_ps(f, scale));
+   }
+   to_float_scalar(x + i, out + i, n - i);
+}
+
+CPU_TARGET("avx2")
+static void to_below_avx2(uint32_t *x, size_t n, uint32_t range)
+{
+   const __m256i r = _mm256_set1_epi32((int)range);
+   const __m256i odd_mask = _mm256_set_epi32(-1, 0, -1, 0, -1, 0, -1, 0);
+   size_t i = 0;
+   for (; i + 8 <= n; i += 8) {
+      const __m256i v = _mm256_loadu_si256((const __m256i *)&x[i]);
+      const __m256i even = _mm256_srli_epi64(_mm256_mul_epu32(v, r), 32);
+      const __m256i odd = _mm256_mul_epu32(_mm256_srli_epi64(v, 32), r);
+      _mm256_storeu_si256(
+          (__m256i *)&x[i],
+          _mm256_or_si256(even, _mm256_and_si256(odd, odd_mask)));
+   }
+   to_below_scalar(x + i, n - i, range);
+}
+
+#endif // CPU_X86
+
+static void lanes_run(struct rng_lanes *l, uint32_t *out, size_t steps)
+{
+#ifdef CPU_X86
+   switch (cpu_isa()) {
+   case CPU_AVX2:
+      lanes_avx2(l, out, steps);
+      return;
+   case CPU_SSE2:
+      lanes_sse2(l, out, steps);
+      return;
+   default:
+      break;
+   }
+#endif
+   lanes_scalar(l, out, steps);
+}
+
+static void to_float(const uint32_t *x, float *out, size_t n)
+{
+#ifdef CPU_X86
+   switch (cpu_isa()) {
+   case CPU_AVX2:
+      to_float_avx2(x, out, n);
+      return;
+   case CPU_SSE2:
+      to_float_sse2(x, out, n);
+      return;
+   default:
+      break;
+   }
+#endif
+   to_float_scalar(x, out, n);
+}
+
+static void to_below(uint32_t *x, size_t n, uint32_t range)
+{
+#ifdef CPU_X86
+   switch (cpu_isa()) {
+   case CPU_AVX2:
+      to_below_avx2(x, n, range);
+      return;
+   case CPU_SSE2:
+      to_below_sse2(x, n, range);
+      return;
+   default:
+      break;
+   }
+#endif
+   to_below_scalar(x, n, range);
+}
+
+void rng_fill_u32(struct rng_lanes *l, uint32_t *out, size_t n)
+{
+   const size_t steps = n / RNG_LANES;
+   lanes_run(l, out, steps);
+
+   // last partial step
+   const size_t done = steps * RNG_LANES;
+   if (done < n) {
+      uint32_t tail[RNG_LANES];
+      lanes_run(l, tail, 1);
+      for (size_t i = done; i < n; i++)
+         out[i] = tail[i - done];
+   }
+}
+
+void rng_fill_below(struct rng_lanes *l, uint32_t *out, size_t n,
+                    uint32_t range)
+{
+   rng_fill_u32(l, out, n);
+   to_below(out, n, range);
+}
+
+void rng_fill_float(struct rng_lanes *l, float *out, size_t n)
+{
+   uint32_t x[RNG_BLOCK];
+
+   // whole blocks keep the lanes in step with rng_fill_u32() of n values
+   for (size_t i = 0; i < n; i += RNG_BLOCK) {
+      const size_t len = (n - i < RNG_BLOCK) ? n - i : RNG_BLOCK;
+      rng_fill_u32(l, x, len);
+      to_float(x, out + i, len);
+   }
+}
+
+// end file rng.c
@@ -0,0 +1,139 @@
+/**
+ * @file span.c
+ * @brief Vectorized kernels for filling and summing spans of samples.
+ *
+ * @author Jakob Kastelic
+ */
+
+#include "span.h"
+#include "cpu.h"
+#include <stddef.h>
+
+#ifdef CPU_X86
+#include <immintrin.h>
+#endif
+
+struct span_ops {
+   void (*zero)(float *dst, size_t n);
+   void (*copy)(float *restrict dst, const float *restrict src, size_t n);
+   void (*add)(float *restrict dst, const float *restrict src, size_t n);
+};
+
+static void zero_scalar(float *dst, size_t n)
+{
+   for (size_t i = 0; i < n; i++)
+      dst[i] = 0.0F;
+}
+
+static void copy_scalar(float *restrict dst, const float *restrict src,
+                        size_t n)
+{
+   for (size_t i = 0; i < n; i++)
+      dst[i] = src[i];
+}
+
+static void add_scalar(float *restrict dst, const float *restrict src, size_t n)
+{
+   for (size_t i = 0; i < n; i++)
+      dst[i] += src[i];
+}
+
+static const struct span_ops scalar_ops = {zero_scalar, copy_scalar,
+                                           add_scalar};
+
+#ifdef CPU_X86
+
+CPU_TARGET("sse2")
+static void zero_sse2(float *dst, size_t n)
+{
+   const __m128 z = _mm_setzero_ps();
+   size_t i = 0;
+   for (; i + 4 <= n; i += 4)
+      _mm_storeu_ps(dst + i, z);
+   zero_scalar(dst + i, n - i);
+}
+
+CPU_TARGET("sse2")
+static void copy_sse2(float *restrict dst, const float *restrict src, size_t n)
+{
+   size_t i = 0;
+   for (; i + 4 <= n; i += 4)
+      _mm_storeu_ps(dst + i, _mm_loadu_ps(src + i));
+   copy_scalar(dst + i, src + i, n - i);
+}
+
+CPU_TARGET("sse2")
+static void add_sse2(float *restrict dst, const float *restrict src, size_t n)
+{
+   size_t i = 0;
+   for (; i + 4 <= n; i += 4)
+      _mm_storeu_ps(dst + i,
+                    _mm_add_ps(_mm_loadu_ps(dst + i), _mm_loadu_ps(src + i)));
+   add_scalar(dst + i, src + i, n - i);
+}
+
+CPU_TARGET("avx2")
+static void zero_avx2(float *dst, size_t n)
+{
+   const __m256 z = _mm256_setzero_ps();
+   size_t i = 0;
+   for (; i + 8 <= n; i += 8)
+      _mm256_storeu_ps(dst + i, z);
+   zero_scalar(dst + i, n - i);
+}
+
+CPU_TARGET("avx2")
+static void copy_avx2(float *restrict dst, const float *restrict src, size_t n)
+{
+   size_t i = 0;
+   for (; i + 8 <= n; i += 8)
+      _mm256_storeu_ps(dst + i, _mm256_loadu_ps(src + i));
+   copy_scalar(dst + i, src + i, n - i);
+}
+
+CPU_TARGET("avx2")
+static void add_avx2(float *restrict dst, const float *restrict src, size_t n)
+{
+   size_t i = 0;
+   for (; i + 8 <= n; i += 8)
+      _mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_loadu_ps(dst + i),
+                                              _mm256_loadu_ps(src + i)));
+   add_scalar(dst + i, src + i, n - i);
+}
+
+static const struct span_ops sse2_ops = {zero_sse2, copy_sse2, add_sse2};
+static const struct span_ops avx2_ops = {zero_avx2, copy_avx2, add_avx2};
+
+#endif // CPU_X86
+
+static const struct span_ops *get_ops(void)
+{
+#ifdef CPU_X86
+   switch (cpu_isa()) {
+   case CPU_AVX2:
+      return &avx2_ops;
+   case CPU_SSE2:
+      return &sse2_ops;
+   default:
+      break;
+   }
+#endif
+   return &scalar_ops;
+}
+
+void span_zero(float *dst, size_t n)
+{
+   get_ops()->zero(dst, n);
+}
+
+void span_copy(float *restrict dst, const float *restrict src, size_t n)
+{
+   get_ops()->copy(dst, src, n);
+}
+
+void span_add(float *restrict dst, const float *restrict src, size_t n)
+{
+   get_ops()->add(dst, src, n);
+}
+
+// end file span.c
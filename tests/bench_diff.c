@@ -0,0 +1,179 @@
+/**
+ * @file bench_diff.c
+ * @brief Benchmarks of the Levenshtein distance functions.
+ *
+ * @author Jakob Kastelic
+ */
+
+#include "bench_diff.h"
+#include "cpu.h"
+#include "debug.h"
+#include "diff.h"
+#include "gen.h"
+#include "record.h"
+#include "rng.h"
+#include "str.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_DIFF_LEN 1000
+#define BENCH_DIFF_RUNS 200
+#define BENCH_DIFF_LONG 20000
+
+/**
+ * @brief Copy s into t with about one character in ten substituted, deleted
+ * or followed by an inserted one, as in a copy session near the target
+ * accuracy.
+ */
+static void bench_mutate(char *t, const char *s, struct rng *rng)
+{
+   size_t k = 0;
+   for (size_t i = 0; s[i]; i++) {
+      const uint32_t r = rng_below(rng, 30);
+      const char c = str_int_to_char((int)rng_below(rng, 36));
+      if (r == 0) {
+         t[k++] = c; // substitution
+      } else if (r == 1) {
+         continue; // deletion
+      } else if (r == 2) {
+         t[k++] = s[i]; // insertion
+         t[k++] = c;
+      } else {
+         t[k++] = s[i];
+      }
+   }
+   t[k] = '\0';
+}
+
+int bench_lev_diff(void)
+{
+   static char s1[BENCH_DIFF_LEN + 1];
+   static char s2[2 * BENCH_DIFF_LEN + 1];
+   struct rng rng;
+   rng_seed(&rng, 1);
+
+   if (gen_chars(s1, sizeof(s1), 2, 8, NULL, NULL, &rng) != 0)
+      return -1;
+   bench_mutate(s2, s1, &rng);
+
+   struct record r = {0};
+   const clock_t t0 = clock();
+   int dist = 0;
+   for (int i = 0; i < BENCH_DIFF_RUNS && dist >= 0; i++)
+      dist = lev_diff(&r, s1, s2);
+   const double secs = (double)(clock() - t0) / CLOCKS_PER_SEC;
+   if (dist < 0)
+      return -1;
+
+   printf("lev_diff: %zu x %zu characters, distance %d\n", strlen(s1),
+          strlen(s2), dist);
+   printf("%-24s %10.1f us/call\n", "lev_diff", 1e6 * secs / BENCH_DIFF_RUNS);
+
+   // the same with a context, whose matrix is allocated only once
+   struct diff_ctx ctx;
+   diff_ctx_init(&ctx);
+   const clock_t t1 = clock();
+   for (int i = 0; i < BENCH_DIFF_RUNS && dist >= 0; i++)
+      dist = lev_diff_ctx(&ctx, &r, s1, s2);
+   const double secs_ctx = (double)(clock() - t1) / CLOCKS_PER_SEC;
+   diff_ctx_free(&ctx);
+   if (dist < 0)
+      return -1;
+
+   printf("%-24s %10.1f us/call\n", "lev_diff_ctx",
+          1e6 * secs_ctx / BENCH_DIFF_RUNS);
+   return 0;
+}
+
+/**
+ * @brief Time one mode of lev_diff_mode() on a pair of strings.
+ */
+static int bench_mode(const char *name, const char *s1, const char *s2,
+                      enum diff_mode mode, int runs)
+{
+   struct diff_ctx ctx;
+   struct record r = {0};
+   diff_ctx_init(&ctx);
+
+   const clock_t t0 = clock();
+   int dist = 0;
+   for (int i = 0; i < runs && dist >= 0; i++)
+      dist = lev_diff_mode(&ctx, &r, s1, s2, mode);
+   const double secs = (double)(clock() - t0) / CLOCKS_PER_SEC;
+   diff_ctx_free(&ctx);
+   if (dist < 0)
+      return -1;
+
+   printf("%-24s %10.1f us/call  distance %d\n", name, 1e6 * secs / runs, dist);
+   return 0;
+}
+
+/**
+ * @brief Time lev_distance(), which skips the alignment.
+ */
+static int bench_distance(const char *s1, const char *s2, int runs)
+{
+   struct diff_ctx ctx;
+   diff_ctx_init(&ctx);
+
+   const clock_t t0 = clock();
+   int dist = 0;
+   for (int i = 0; i < runs && dist >= 0; i++)
+      dist = lev_distance(&ctx, s1, s2);
+   const double secs = (double)(clock() - t0) / CLOCKS_PER_SEC;
+   diff_ctx_free(&ctx);
+   if (dist < 0)
+      return -1;
+
+   printf("%-24s %10.1f us/call  distance %d\n", "lev_distance",
+          1e6 * secs / runs, dist);
+   return 0;
+}
+
+int bench_lev_diff_modes(void)
+{
+   static char s1[BENCH_DIFF_LONG + 1];
+   static char s2[2 * BENCH_DIFF_LONG + 1];
+   struct rng rng;
+   rng_seed(&rng, 2);
+
+   if (gen_chars(s1, BENCH_DIFF_LEN + 1, 2, 8, NULL, NULL, &rng) != 0)
+      return -1;
+   bench_mutate(s2, s1, &rng);
+   printf("lev_diff_mode: %zu x %zu characters\n", strlen(s1), strlen(s2));
+
+   // the full matrix without the vectorized kernel, for comparison
+   const enum cpu_isa best = cpu_isa();
+   if (cpu_set_isa(CPU_SCALAR) != 0 ||
+       bench_mode("DIFF_FULL (scalar)", s1, s2, DIFF_FULL, BENCH_DIFF_RUNS) !=
+           0 ||
+       cpu_set_isa(best) != 0)
+      return -1;
+
+   if (bench_mode("DIFF_FULL", s1, s2, DIFF_FULL, BENCH_DIFF_RUNS) != 0 ||
+       bench_mode("DIFF_HIRSCHBERG", s1, s2, DIFF_HIRSCHBERG,
+                  BENCH_DIFF_RUNS) != 0 ||
+       bench_mode("DIFF_BITPARALLEL", s1, s2, DIFF_BITPARALLEL,
+                  BENCH_DIFF_RUNS) != 0 ||
+       bench_mode("DIFF_BANDED", s1, s2, DIFF_BANDED, BENCH_DIFF_RUNS) != 0 ||
+       bench_distance(s1, s2, BENCH_DIFF_RUNS) != 0)
+      return -1;
+
+   // too long for the full matrix (1.6 GB)
+   for (size_t i = 0; i < BENCH_DIFF_LONG; i += BENCH_DIFF_LEN) {
+      if (gen_chars(s1 + i, BENCH_DIFF_LEN + 1, 2, 8, NULL, NULL, &rng) != 0)
+         return -1;
+      s1[i + BENCH_DIFF_LEN - 1] = ' ';
+   }
+   s1[BENCH_DIFF_LONG] = '\0';
+   bench_mutate(s2, s1, &rng);
+   printf("lev_diff_mode: %zu x %zu characters\n", strlen(s1), strlen(s2));
+   if (bench_mode("DIFF_HIRSCHBERG", s1, s2, DIFF_HIRSCHBERG, 1) != 0 ||
+       bench_mode("DIFF_BITPARALLEL", s1, s2, DIFF_BITPARALLEL, 1) != 0 ||
+       bench_mode("DIFF_BANDED", s1, s2, DIFF_BANDED, 1) != 0)
+      return -1;
+   return bench_distance(s1, s2, 1);
+}
+
+// end file bench_diff.c
@@ -0,0 +1,16 @@
+/**
+ * @file bench_diff.h
+ * @brief Benchmarks of the Levenshtein distance functions.
+ *
+ * @author Jakob Kastelic
+ */
+
+#ifndef BENCH_DIFF_H
+#define BENCH_DIFF_H
+
+int bench_lev_diff(void);
+int bench_lev_diff_modes(void);
+
+#endif // BENCH_DIFF_H
+
+// end file bench_diff.h
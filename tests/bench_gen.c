@@ -0,0 +1,184 @@
+/**
+ * @file bench_gen.c
+ * @brief Benchmarks of the text generation functions.
+ *
+ * @author Jakob Kastelic
+ */
+
+#include "bench_gen.h"
+#include "alias.h"
+#include "debug.h"
+#include "gen.h"
+#include "rng.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define BENCH_WORDS 2000000
+#define BENCH_LOADS 200
+#define BENCH_TEXTS 100
+#define BENCH_DRAWS 256
+
+/**
+ * @brief The former write path: two fprintf() calls per word.
+ *
+ * Words are drawn exactly as write_words_sampler() draws them, from lanes
+ * split off rng and the same alias table, so both writers produce the same
+ * text and the comparison measures the output path alone.
+ */
+static int bench_fprintf_words(FILE *out, const struct word_sampler *ws,
+                               int nw, struct rng *rng)
+{
+   struct rng_lanes lanes;
+   uint32_t draws[BENCH_DRAWS];
+   size_t pos = BENCH_DRAWS;
+   rng_lanes_init(&lanes, rng);
+
+   for (int i = 0; i < nw; ++i) {
+      if (pos == BENCH_DRAWS) {
+         rng_fill_u32(&lanes, draws, BENCH_DRAWS);
+         pos = 0;
+      }
+      const int k = alias_pick(&ws->table, draws[pos++]);
+      if (fprintf(out, "%s", ws->words[k]) < 0)
+         return -1;
+      if (i < nw - 1) {
+         if (fprintf(out, " ") < 0)
+            return -1;
+      }
+   }
+   return (fprintf(out, "\n") < 0) ? -1 : 0;
+}
+
+static double bench_run(const char *name, const char *out_file,
+                        const struct word_sampler *ws, int buffered)
+{
+   struct rng rng;
+   rng_seed(&rng, 1);
+
+   FILE *out = fopen(out_file, "w");
+   if (!out) {
+      ERROR("cannot open file '%s'", out_file);
+      return -1.0;
+   }
+
+   const clock_t t0 = clock();
+   const int ret = buffered ? write_words_sampler(out, ws, BENCH_WORDS, &rng)
+                            : bench_fprintf_words(out, ws, BENCH_WORDS, &rng);
+   const int closed = fclose(out);
+   const double secs = (double)(clock() - t0) / CLOCKS_PER_SEC;
+
+   if (ret != 0 || closed != 0) {
+      ERROR("writing '%s' failed", out_file);
+      return -1.0;
+   }
+
+   const double rate = (secs > 0.0) ? BENCH_WORDS / secs : 0.0;
+   printf("%-24s %8.3f s %14.0f words/s\n", name, secs, rate);
+   return rate;
+}
+
+int bench_write_words(const char *word_file, const char *out_file)
+{
+   struct WordEntry *entries = NULL;
+   const int count = parse_word_file(word_file, &entries, 0);
+   if (count < 1) {
+      ERROR("could not parse file");
+      return -1;
+   }
+
+   struct word_sampler ws;
+   if (word_sampler_init(&ws, entries, count,
+                         compute_total_weight(entries, count)) != 0) {
+      free_entries(entries, count);
+      return -1;
+   }
+
+   printf("write_words: %d words from %s (%d entries)\n", BENCH_WORDS,
+          word_file, count);
+   const double before = bench_run("fprintf per word", out_file, &ws, 0);
+   const double after = bench_run("block buffer + fwrite", out_file, &ws, 1);
+
+   word_sampler_free(&ws);
+   free_entries(entries, count);
+   if (remove(out_file) != 0)
+      ERROR("failed to remove file '%s'", out_file);
+
+   if (before <= 0.0 || after <= 0.0)
+      return -1;
+   printf("speedup: %.1fx\n", after / before);
+   return 0;
+}
+
+int bench_load_words(const char *word_file)
+{
+   printf("load: %s, %d times\n", word_file, BENCH_LOADS);
+
+   clock_t t0 = clock();
+   for (int i = 0; i < BENCH_LOADS; ++i) {
+      struct WordEntry *entries = NULL;
+      const int count = parse_word_file(word_file, &entries, 0);
+      if (count < 1)
+         return -1;
+      free_entries(entries, count);
+   }
+   const double before = (double)(clock() - t0) / CLOCKS_PER_SEC;
+   printf("%-24s %8.3f s\n", "parse_word_file", before);
+
+   t0 = clock();
+   for (int i = 0; i < BENCH_LOADS; ++i) {
+      struct word_dict wd;
+      if (word_dict_load(&wd, word_file, 0) < 1)
+         return -1;
+      word_dict_free(&wd);
+   }
+   const double after = (double)(clock() - t0) / CLOCKS_PER_SEC;
+   printf("%-24s %8.3f s\n", "word_dict_load", after);
+
+   if (after > 0.0)
+      printf("speedup: %.1fx\n", before / after);
+   return 0;
+}
+
+int bench_markov(const char *word_file)
+{
+   static char s[GEN_MAX];
+   struct word_dict wd;
+   if (word_dict_load(&wd, word_file, 0) < 1)
+      return -1;
+
+   struct rng rng;
+   rng_seed(&rng, 1);
+   printf("markov_gen: %d x %d characters, trained on %s\n", BENCH_TEXTS,
+          GEN_MAX, word_file);
+
+   for (int order = 1; order <= MARKOV_MAX_ORDER; order++) {
+      struct markov m;
+      if (markov_train(&m, order, &wd, NULL) != 0) {
+         word_dict_free(&wd);
+         return -1;
+      }
+
+      const clock_t t0 = clock();
+      int ret = 0;
+      for (int i = 0; i < BENCH_TEXTS && ret == 0; i++)
+         ret = markov_gen(&m, s, GEN_MAX, 2, 8, &rng);
+      const double secs = (double)(clock() - t0) / CLOCKS_PER_SEC;
+      const int states = m.states;
+      markov_free(&m);
+      if (ret != 0) {
+         word_dict_free(&wd);
+         return -1;
+      }
+
+      const double rate = (secs > 0.0) ? BENCH_TEXTS * GEN_MAX / secs : 0.0;
+      printf("order %d: %6d states %14.0f chars/s  %.40s\n", order, states,
+             rate, s);
+   }
+
+   word_dict_free(&wd);
+   return 0;
+}
+
+// end file bench_gen.c
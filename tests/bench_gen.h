@@ -0,0 +1,17 @@
+/**
+ * @file bench_gen.h
+ * @brief Benchmarks of the text generation functions.
+ *
+ * @author Jakob Kastelic
+ */
+
+#ifndef BENCH_GEN_H
+#define BENCH_GEN_H
+
+int bench_write_words(const char *word_file, const char *out_file);
+int bench_load_words(const char *word_file);
+int bench_markov(const char *word_file);
+
+#endif // BENCH_GEN_H
+
+// end file bench_gen.h
@@ -0,0 +1,90 @@
+/**
+ * @file test_alias.c
+ * @brief Test the alias-method sampler.
+ *
+ * @author Jakob Kastelic
+ */
+
+#include "alias.h"
+#include "debug.h"
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define TEST_ALIAS_N 7
+#define TEST_ALIAS_DRAWS 1000000
+
+int test_alias_pick(void)
+{
+   const float w[TEST_ALIAS_N] = {1.0F, 0.0F, 5.0F, 0.5F, 2.5F, 0.0F, 11.0F};
+   float sum = 0.0F;
+   for (int i = 0; i < TEST_ALIAS_N; i++)
+      sum += w[i];
+
+   struct alias a;
+   if (alias_init(&a, w, TEST_ALIAS_N) != 0) {
+      TEST_FAIL("alias_init failed");
+      return -1;
+   }
+
+   // sweep the draws evenly over all 32-bit values: the counts then follow
+   // the weights up to the resolution of the sweep
+   long count[TEST_ALIAS_N] = {0};
+   const uint64_t step = (1ULL << 32U) / TEST_ALIAS_DRAWS;
+   for (uint64_t k = 0; k < TEST_ALIAS_DRAWS; k++) {
+      const int i = alias_pick(&a, (uint32_t)(k * step));
+      if (i < 0 || i >= TEST_ALIAS_N) {
+         TEST_FAIL("outcome %d out of range", i);
+         alias_free(&a);
+         return -1;
+      }
+      count[i]++;
+   }
+   alias_free(&a);
+
+   for (int i = 0; i < TEST_ALIAS_N; i++) {
+      const double want = TEST_ALIAS_DRAWS * (double)(w[i] / sum);
+      if (fabs((double)count[i] - want) > 0.001 * TEST_ALIAS_DRAWS ||
+          (w[i] == 0.0F && count[i] != 0)) {
+         TEST_FAIL("outcome %d drawn %ld times, expected %.0f", i, count[i],
+                   want);
+         return -1;
+      }
+   }
+
+   // a single outcome is always chosen
+   const float one = 3.0F;
+   if (alias_init(&a, &one, 1) != 0 || alias_pick(&a, 0) != 0 ||
+       alias_pick(&a, UINT32_MAX) != 0) {
+      TEST_FAIL("single outcome not chosen");
+      alias_free(&a);
+      return -1;
+   }
+   alias_free(&a);
+
+   TEST_SUCCESS();
+   return 0;
+}
+
+int test_alias_invalid(void)
+{
+   const float zero[3] = {0.0F, 0.0F, 0.0F};
+   const float neg[3] = {1.0F, -1.0F, 1.0F};
+   struct alias a;
+
+   debug_set_silent(true);
+   const int r1 = alias_init(&a, zero, 3);
+   const int r2 = alias_init(&a, neg, 3);
+   const int r3 = alias_init(&a, zero, 0);
+   debug_set_silent(false);
+
+   if (r1 != -1 || r2 != -1 || r3 != -1) {
+      TEST_FAIL("invalid weights accepted");
+      return -1;
+   }
+
+   TEST_SUCCESS();
+   return 0;
+}
+
+// end file test_alias.c
@@ -0,0 +1,16 @@
+/**
+ * @file test_alias.h
+ * @brief Test the alias-method sampler.
+ *
+ * @author Jakob Kastelic
+ */
+
+#ifndef TEST_ALIAS_H
+#define TEST_ALIAS_H
+
+int test_alias_pick(void);
+int test_alias_invalid(void);
+
+#endif // TEST_ALIAS_H
+
+// end file test_alias.h
@@ -0,0 +1,71 @@
+/**
+ * @file test_arena.c
+ * @brief Test the bump allocator.
+ *
+ * @author Jakob Kastelic
+ */
+
+#include "arena.h"
+#include "debug.h"
+#include <stdint.h>
+#include <string.h>
+
+#define TEST_ARENA_BLOCK 64
+#define TEST_ARENA_ALLOCS 100
+
+int test_arena_alloc(void)
+{
+   struct arena a;
+   arena_init(&a, TEST_ARENA_BLOCK);
+
+   // many small allocations spill over into new blocks; each must be aligned
+   // and keep its contents while the others are written
+   unsigned char *p[TEST_ARENA_ALLOCS];
+   for (int i = 0; i < TEST_ARENA_ALLOCS; i++) {
+      const size_t n = (size_t)(i % 13) + 1;
+      p[i] = arena_alloc(&a, n);
+      if (!p[i] || ((uintptr_t)p[i] % sizeof(double)) != 0) {
+         TEST_FAIL("allocation %d missing or misaligned", i);
+         arena_free(&a);
+         return -1;
+      }
+      memset(p[i], i, n);
+   }
+   for (int i = 0; i < TEST_ARENA_ALLOCS; i++) {
+      const size_t n = (size_t)(i % 13) + 1;
+      for (size_t k = 0; k < n; k++) {
+         if (p[i][k] != (unsigned char)i) {
+            TEST_FAIL("allocation %d overwritten", i);
+            arena_free(&a);
+            return -1;
+         }
+      }
+   }
+
+   // larger than a block
+   unsigned char *big = arena_alloc(&a, 3 * TEST_ARENA_BLOCK);
+   if (!big) {
+      TEST_FAIL("large allocation failed");
+      arena_free(&a);
+      return -1;
+   }
+   memset(big, 0xFF, 3 * TEST_ARENA_BLOCK);
+   if (p[TEST_ARENA_ALLOCS - 1][0] != TEST_ARENA_ALLOCS - 1) {
+      TEST_FAIL("large allocation overlaps");
+      arena_free(&a);
+      return -1;
+   }
+
+   // the arena is reusable after being freed
+   arena_free(&a);
+   if (!arena_alloc(&a, 1)) {
+      TEST_FAIL("allocation after free failed");
+      return -1;
+   }
+   arena_free(&a);
+
+   TEST_SUCCESS();
+   return 0;
+}
+
+// end file test_arena.c
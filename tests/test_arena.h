@@ -0,0 +1,15 @@
+/**
+ * @file test_arena.h
+ * @brief Test the bump allocator.
+ *
+ * @author Jakob Kastelic
+ */
+
+#ifndef TEST_ARENA_H
+#define TEST_ARENA_H
+
+int test_arena_alloc(void);
+
+#endif // TEST_ARENA_H
+
+// end file test_arena.h
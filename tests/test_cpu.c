@@ -0,0 +1,49 @@
+/**
+ * @file test_cpu.c
+ * @brief Test the selection of the instruction set.
+ *
+ * @author Jakob Kastelic
+ */
+
+#include "cpu.h"
+#include "debug.h"
+#include <stddef.h>
+
+int test_cpu_select(void)
+{
+   const enum cpu_isa best = cpu_isa();
+   const enum cpu_isa all[] = {CPU_SCALAR, CPU_SSE2, CPU_AVX2};
+
+   if (!cpu_supports(CPU_SCALAR) || !cpu_supports(best)) {
+      TEST_FAIL("selected isa %d not supported", (int)best);
+      return -1;
+   }
+
+   // the best supported one is selected by default
+   for (size_t k = 0; k < sizeof(all) / sizeof(all[0]); k++) {
+      if (all[k] > best && cpu_supports(all[k])) {
+         TEST_FAIL("isa %d selected, but %d supported", (int)best, (int)all[k]);
+         return -1;
+      }
+   }
+
+   for (size_t k = 0; k < sizeof(all) / sizeof(all[0]); k++) {
+      const int ok = cpu_set_isa(all[k]) == 0;
+      if (ok != cpu_supports(all[k]) || (ok && cpu_isa() != all[k])) {
+         TEST_FAIL("cannot select isa %d", (int)all[k]);
+         cpu_set_isa(best);
+         return -1;
+      }
+   }
+
+   if (cpu_set_isa((enum cpu_isa)99) != -1 || cpu_set_isa(best) != 0 ||
+       cpu_isa() != best) {
+      TEST_FAIL("invalid isa accepted or best isa not restored");
+      return -1;
+   }
+
+   TEST_SUCCESS();
+   return 0;
+}
+
+// end file test_cpu.c
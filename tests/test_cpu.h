@@ -0,0 +1,15 @@
+/**
+ * @file test_cpu.h
+ * @brief Test the selection of the instruction set.
+ *
+ * @author Jakob Kastelic
+ */
+
+#ifndef TEST_CPU_H
+#define TEST_CPU_H
+
+int test_cpu_select(void);
+
+#endif // TEST_CPU_H
+
+// end file test_cpu.h
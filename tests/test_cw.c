@@ -7,8 +7,23 @@
 
 #include "cw.h"
 #include "debug.h"
+#include "str.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+#define TEST_SR 48000
+#define TEST_SESSIONS 4
+
+struct test_cw_session {
+   const char *text;
+   struct cw_data cw;
+   float *buf;
+   long frames;
+};
+
 int test_ascii_to_morse_expanded(void)
 {
    struct {
@@ -18,7 +33,9 @@ int test_ascii_to_morse_expanded(void)
                 {"SOS", "...|---|..."},
                 {"HELLO WORLD", "....|.|.-..|.-..|---/.--|---|.-.|.-..|-.."},
                 {"", ""},
-                {"123", ".----|..---|...--"}};
+                {"123", ".----|..---|...--"},
+                {"  ab  c ", ".-|-.../-.-./"},
+                {"a#b", ".-|-..."}};
 
    char buf[256];
 
@@ -102,4 +119,408 @@ int test_count_units(void)
    return 0;
 }
 
+int test_cw_render(void)
+{
+   struct cw_data cw = {.freq = 600.0F,
+                        .amp = 0.5F,
+                        .delay_sec = 0.1F,
+                        .speed1 = 20.0F,
+                        .speed2 = 20.0F};
+
+   // "E" is a single dit: fetch frame, dot and intra-character gap
+   const long dot = (long)(60.0F / (50.0F * 20.0F) * TEST_SR);
+   const long delay = (long)(0.1F * TEST_SR);
+   const long expected = delay + 1 + dot + dot;
+
+   const long total = cw_render("E", &cw, NULL, 0);
+   if (total != expected) {
+      TEST_FAIL("expected %ld frames, got %ld", expected, total);
+      return -1;
+   }
+
+   float *buf = calloc((size_t)total * 2, sizeof(float));
+   if (!buf) {
+      TEST_FAIL("out of memory");
+      return -1;
+   }
+
+   if (cw_render("E", &cw, buf, (size_t)total) != total) {
+      free(buf);
+      TEST_FAIL("rendering returned wrong length");
+      return -1;
+   }
+
+   float peak = 0.0F;
+   for (long i = 0; i < total * 2; i++) {
+      const float x = fabsf(buf[i]);
+      if (i < (delay + 1) * 2 && x != 0.0F) {
+         free(buf);
+         TEST_FAIL("sound during initial delay");
+         return -1;
+      }
+      if (x > peak)
+         peak = x;
+   }
+   free(buf);
+
+   if (peak < 0.45F || peak > 0.5F) {
+      TEST_FAIL("peak amplitude %.3f, expected 0.5", peak);
+      return -1;
+   }
+
+   // invalid parameters
+   debug_set_silent(true);
+   cw.speed2 = 30.0F;
+   if (cw_render("E", &cw, NULL, 0) >= 0) {
+      debug_set_silent(false);
+      TEST_FAIL("accepted speed2 > speed1");
+      return -1;
+   }
+   debug_set_silent(false);
+
+   TEST_SUCCESS();
+   return 0;
+}
+
+int test_cw_oscillator(void)
+{
+   struct cw_data cw = {
+       .freq = 700.0F, .amp = 0.3F, .speed1 = 20.0F, .speed2 = 20.0F};
+
+   // "T" is a single dah, starting after the one-frame symbol fetch
+   const long total = cw_render("T", &cw, NULL, 0);
+   float *buf = calloc((size_t)total * 2, sizeof(float));
+   if (!buf) {
+      TEST_FAIL("out of memory");
+      return -1;
+   }
+   cw_render("T", &cw, buf, (size_t)total);
+
+   // away from the fade ramps, compare with the exact sine, which starts
+   // with zero phase on every element
+   const long dah = 3 * cw.dot_len;
+   const double w = 2.0 * 3.14159265358979323846 * 700.0 / TEST_SR;
+   for (long n = 1 + 100; n < 1 + dah - 100; n++) {
+      const float exact = 0.3F * (float)sin(w * (double)(n - 1));
+      if (fabsf(buf[2 * n] - exact) > 1e-4F || buf[(2 * n) + 1] != buf[2 * n]) {
+         TEST_FAIL("sample %ld is %.6f, expected %.6f", n, buf[2 * n], exact);
+         free(buf);
+         return -1;
+      }
+   }
+
+   free(buf);
+   TEST_SUCCESS();
+   return 0;
+}
+
+static void *test_cw_render_thread(void *arg)
+{
+   struct test_cw_session *ts = (struct test_cw_session *)arg;
+   ts->frames = cw_render(ts->text, &ts->cw, ts->buf, (size_t)ts->frames);
+   return NULL;
+}
+
+static void test_cw_free_sessions(struct test_cw_session *ts, float **ref)
+{
+   for (int k = 0; k < TEST_SESSIONS; k++) {
+      free(ts[k].buf);
+      free(ref[k]);
+   }
+}
+
+int test_cw_sessions(void)
+{
+   static const char *const texts[TEST_SESSIONS] = {"cq de s50", "paris",
+                                                    "73 tu", "qrl? qrl?"};
+   struct test_cw_session ts[TEST_SESSIONS] = {{0}};
+   float *ref[TEST_SESSIONS] = {0};
+
+   // render every session twice in a row, with different parameters
+   for (int k = 0; k < TEST_SESSIONS; k++) {
+      ts[k].text = texts[k];
+      ts[k].cw.freq = 500.0F + (100.0F * (float)k);
+      ts[k].cw.amp = 0.2F;
+      ts[k].cw.delay_sec = 0.05F * (float)k;
+      ts[k].cw.speed1 = 20.0F + (5.0F * (float)k);
+      ts[k].cw.speed2 = 15.0F;
+
+      ts[k].frames = cw_render(texts[k], &ts[k].cw, NULL, 0);
+      ts[k].buf = calloc((size_t)ts[k].frames * 2, sizeof(float));
+      ref[k] = calloc((size_t)ts[k].frames * 2, sizeof(float));
+      if (!ts[k].buf || !ref[k]) {
+         test_cw_free_sessions(ts, ref);
+         TEST_FAIL("out of memory");
+         return -1;
+      }
+      cw_render(texts[k], &ts[k].cw, ref[k], (size_t)ts[k].frames);
+   }
+
+   // then all of them at once, in parallel threads
+   pthread_t threads[TEST_SESSIONS];
+   for (int k = 0; k < TEST_SESSIONS; k++) {
+      if (pthread_create(&threads[k], NULL, test_cw_render_thread, &ts[k]) !=
+          0) {
+         TEST_FAIL("cannot start thread");
+         for (int j = 0; j < k; j++)
+            pthread_join(threads[j], NULL);
+         test_cw_free_sessions(ts, ref);
+         return -1;
+      }
+   }
+
+   int ret = 0;
+   for (int k = 0; k < TEST_SESSIONS; k++) {
+      if (pthread_join(threads[k], NULL) != 0)
+         ret = -1;
+   }
+
+   for (int k = 0; k < TEST_SESSIONS && ret == 0; k++) {
+      const size_t len = sizeof(float) * 2 * (size_t)ts[k].frames;
+      if (memcmp(ts[k].buf, ref[k], len) != 0) {
+         TEST_FAIL("session %d differs when rendered in parallel", k);
+         ret = -1;
+      }
+   }
+
+   test_cw_free_sessions(ts, ref);
+   if (ret == 0)
+      TEST_SUCCESS();
+   return ret;
+}
+
+int test_cw_render_wav(const char *test_file)
+{
+   struct cw_data cw = {
+       .freq = 700.0F, .amp = 0.3F, .speed1 = 25.0F, .speed2 = 15.0F};
+
+   const long frames = cw_render("PARIS PARIS", &cw, NULL, 0);
+   const int ms = cw_render_wav("PARIS PARIS", &cw, test_file);
+   if (frames < 0 || ms != (int)((frames * 1000) / TEST_SR)) {
+      TEST_FAIL("cw_render_wav returned %d ms for %ld frames", ms, frames);
+      return -1;
+   }
+
+   // 44-byte header, then 16-bit stereo samples
+   const int len = str_file_len(test_file);
+   if (remove(test_file) != 0) {
+      ERROR("failed to remove file '%s'", test_file);
+      return -1;
+   }
+   if (len != 44 + (int)(frames * 4)) {
+      TEST_FAIL("WAV file has %d bytes, expected %ld", len, 44 + (frames * 4));
+      return -1;
+   }
+
+   // over 4 GiB of samples do not fit the 32-bit sizes in the header
+   cw.delay_sec = 25000.0F;
+   debug_set_silent(true);
+   const int long_ms = cw_render_wav("e", &cw, test_file);
+   debug_set_silent(false);
+   FILE *fp = fopen(test_file, "rb");
+   const int written = (fp != NULL);
+   if (fp) {
+      if (fclose(fp) != 0 || remove(test_file) != 0)
+         ERROR("failed to remove file '%s'", test_file);
+   }
+   if (long_ms != -1 || written) {
+      TEST_FAIL("wrote a WAV file too long for its header");
+      return -1;
+   }
+
+   TEST_SUCCESS();
+   return 0;
+}
+
+int test_cw_mix(void)
+{
+   struct cw_voice v[2] = {
+       {.text = "cq cq de s50",
+        .cw = {.freq = 600.0F, .amp = 0.3F, .speed1 = 25.0F, .speed2 = 20.0F}},
+       {.text = "qrl?",
+        .cw = {.freq = 750.0F,
+               .amp = 0.2F,
+               .delay_sec = 0.3F,
+               .speed1 = 18.0F,
+               .speed2 = 18.0F}},
+   };
+
+   const long f0 = cw_render(v[0].text, &v[0].cw, NULL, 0);
+   const long f1 = cw_render(v[1].text, &v[1].cw, NULL, 0);
+   const long total = cw_mix(v, 2, NULL, 0);
+   if (f0 <= 0 || f1 <= 0 || total != ((f0 > f1) ? f0 : f1)) {
+      TEST_FAIL("mix of %ld and %ld frames has %ld frames", f0, f1, total);
+      return -1;
+   }
+
+   float *a = calloc((size_t)total * 2, sizeof(float));
+   float *b = calloc((size_t)total * 2, sizeof(float));
+   float *mix = calloc((size_t)total * 2, sizeof(float));
+   if (!a || !b || !mix) {
+      free(a);
+      free(b);
+      free(mix);
+      TEST_FAIL("out of memory");
+      return -1;
+   }
+
+   cw_render(v[0].text, &v[0].cw, a, (size_t)total);
+   cw_render(v[1].text, &v[1].cw, b, (size_t)total);
+   cw_mix(v, 2, mix, (size_t)total);
+
+   int ret = 0;
+   for (long i = 0; i < total * 2; i++) {
+      if (fabsf(mix[i] - (a[i] + b[i])) > 1e-6F) {
+         TEST_FAIL("mix differs from sum of voices at sample %ld", i);
+         ret = -1;
+         break;
+      }
+   }
+
+   free(a);
+   free(b);
+   free(mix);
+
+   debug_set_silent(true);
+   const long bad = cw_mix(v, 0, NULL, 0);
+   debug_set_silent(false);
+   if (bad != -1) {
+      TEST_FAIL("empty mix accepted");
+      return -1;
+   }
+
+   if (ret == 0)
+      TEST_SUCCESS();
+   return ret;
+}
+
+int test_cw_format(void)
+{
+   struct cw_data st = {
+       .freq = 600.0F, .amp = 0.5F, .speed1 = 20.0F, .speed2 = 20.0F};
+   struct cw_data mono = st;
+   mono.sample_rate = 16000;
+   mono.channels = 1;
+
+   const long st_frames = cw_render("test", &st, NULL, 0);
+   const long mono_frames = cw_render("test", &mono, NULL, 0);
+   if (st.sample_rate != 48000 || st.channels != 2 || st.periods != 1 ||
+       st.period_frames != 64) {
+      TEST_FAIL("defaults not applied");
+      return -1;
+   }
+   if (labs(st_frames - (3 * mono_frames)) > 64) {
+      TEST_FAIL("%ld frames at 16 kHz vs. %ld at 48 kHz", mono_frames,
+                st_frames);
+      return -1;
+   }
+
+   // one sample per frame, and the tone is the same on every channel
+   float *buf = calloc((size_t)mono_frames + 1, sizeof(float));
+   if (!buf) {
+      TEST_FAIL("out of memory");
+      return -1;
+   }
+   buf[mono_frames] = 42.0F;
+   cw_render("test", &mono, buf, (size_t)mono_frames);
+   float peak = 0.0F;
+   for (long i = 0; i < mono_frames; i++)
+      peak = fmaxf(peak, fabsf(buf[i]));
+   const float guard = buf[mono_frames];
+   free(buf);
+   if (guard != 42.0F || peak < 0.45F || peak > 0.5F) {
+      TEST_FAIL("mono render: peak %f, guard %f", peak, guard);
+      return -1;
+   }
+
+   struct cw_data bad = st;
+   bad.channels = 9;
+   debug_set_silent(true);
+   const long ret = cw_render("test", &bad, NULL, 0);
+   debug_set_silent(false);
+   if (ret != -1) {
+      TEST_FAIL("9 channels accepted");
+      return -1;
+   }
+
+   TEST_SUCCESS();
+   return 0;
+}
+
+int test_cw_play_backend(void)
+{
+   struct cw_data cw = {.freq = 600.0F,
+                        .amp = 0.1F,
+                        .speed1 = 100.0F,
+                        .speed2 = 100.0F,
+                        .period_frames = 256,
+                        .periods = 2,
+                        .backend = "null"};
+
+   // about 200 ms, more than the ring holds, so the worker has to wait for
+   // the callback to make room
+   const char *text = "ee ee";
+   if (cw_play_start(text, &cw) != 0) {
+      TEST_FAIL("cannot play on the null backend");
+      return -1;
+   }
+   const float latency = cw.latency_ms;
+   const int ms = cw_play_wait(&cw);
+
+   const long frames = cw_render(text, &cw, NULL, 0);
+   if (ms != (int)((frames * 1000) / TEST_SR)) {
+      TEST_FAIL("played %d ms, expected %ld", ms, (frames * 1000) / TEST_SR);
+      return -1;
+   }
+   if (latency <= 0.0F) {
+      TEST_FAIL("latency %f ms not reported", latency);
+      return -1;
+   }
+
+   cw.backend = "no such backend";
+   debug_set_silent(true);
+   const int bad = cw_play_start("e", &cw);
+   debug_set_silent(false);
+   if (bad != -1) {
+      TEST_FAIL("unknown backend accepted");
+      return -1;
+   }
+
+   TEST_SUCCESS();
+   return 0;
+}
+
+int test_cw_mix_play(void)
+{
+   struct cw_voice v[2] = {
+       {.text = "ee ee",
+        .cw = {.freq = 600.0F,
+               .amp = 0.3F,
+               .speed1 = 100.0F,
+               .speed2 = 100.0F,
+               .backend = "null"}},
+       {.text = "tt",
+        .cw = {.freq = 750.0F,
+               .amp = 0.2F,
+               .delay_sec = 0.05F,
+               .speed1 = 80.0F,
+               .speed2 = 80.0F}},
+   };
+
+   const long total = cw_mix(v, 2, NULL, 0);
+   const int ms = cw_mix_play(v, 2);
+   if (total <= 0 || ms != (int)((total * 1000) / TEST_SR)) {
+      TEST_FAIL("played %d ms, expected %ld", ms, (total * 1000) / TEST_SR);
+      return -1;
+   }
+   if (v[0].cw.latency_ms <= 0.0F || v[0].cw.player || v[0].cw.dit_wave ||
+       v[1].cw.dit_wave) {
+      TEST_FAIL("player not set up or not released");
+      return -1;
+   }
+
+   TEST_SUCCESS();
+   return 0;
+}
+
 // end file test_cw.c
@@ -10,6 +10,14 @@
 
 int test_ascii_to_morse_expanded(void);
 int test_count_units(void);
+int test_cw_render(void);
+int test_cw_oscillator(void);
+int test_cw_sessions(void);
+int test_cw_render_wav(const char *test_file);
+int test_cw_mix(void);
+int test_cw_format(void);
+int test_cw_play_backend(void);
+int test_cw_mix_play(void);
 
 #endif // TEST_CW_H
 
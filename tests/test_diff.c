@@ -5,14 +5,20 @@
  * @author Jakob Kastelic
  */
 
+#include "cpu.h"
 #include "debug.h"
 #include "diff.h"
 #include "record.h"
+#include "rng.h"
 #include "str.h"
 #include <math.h>
 #include <stddef.h>
+#include <stdlib.h>
 
-#define TEST_DIFF_NUM 6
+#define TEST_DIFF_NUM 7
+#define TEST_DIFF_PAIRS 300
+#define TEST_DIFF_MAX_LEN 400
+#define TEST_DIFF_SIMD_LEN 2000
 
 struct test_diff_case {
    const char *s1;
@@ -72,6 +78,12 @@ static struct test_diff_case get_diff_test_case(const int i)
       tc.expected_distance = 0;
    }
 
+   else if (i == 6) {
+      tc.s1 = "ab c";
+      tc.s2 = "abc";
+      tc.expected_distance = 1; // spaces are not tracked
+   }
+
    else {
       ERROR("invalid test case number");
    }
@@ -120,4 +132,166 @@ int test_diff(void)
    return 0;
 }
 
+int test_diff_ctx(void)
+{
+   struct diff_ctx ctx;
+   diff_ctx_init(&ctx);
+
+   // one context for all cases, twice over, so the scratch matrix is reused
+   // for both shorter and longer strings
+   for (int k = 0; k < 2 * TEST_DIFF_NUM; ++k) {
+      const int i = k % TEST_DIFF_NUM;
+      struct test_diff_case tc = get_diff_test_case(i);
+      struct record r = {0};
+
+      int dist = lev_diff_ctx(&ctx, &r, tc.s1, tc.s2);
+      if (dist != tc.expected_distance) {
+         TEST_FAIL("test %d: expected distance %d, got %d", i,
+                   tc.expected_distance, dist);
+         diff_ctx_free(&ctx);
+         return -1;
+      }
+
+      if (compare_weights(r.weights, tc.w_exp, MAX_CHARSET_LEN, i) != 0) {
+         diff_ctx_free(&ctx);
+         return -1;
+      }
+   }
+
+   diff_ctx_free(&ctx);
+   TEST_SUCCESS();
+   return 0;
+}
+
+/**
+ * @brief Random string over a small alphabet, so that alignments have many
+ * ties for the traceback to break.
+ */
+static void random_string(char *s, size_t len, struct rng *rng)
+{
+   static const char alphabet[] = "abc d";
+   for (size_t i = 0; i < len; ++i)
+      s[i] = alphabet[rng_below(rng, sizeof(alphabet) - 1)];
+   s[len] = '\0';
+}
+
+int test_diff_modes(void)
+{
+   static char s1[TEST_DIFF_MAX_LEN + 1];
+   static char s2[TEST_DIFF_MAX_LEN + 1];
+   const enum diff_mode modes[] = {DIFF_AUTO, DIFF_HIRSCHBERG,
+                                   DIFF_BITPARALLEL, DIFF_BANDED};
+   struct diff_ctx ctx;
+   struct rng rng;
+   diff_ctx_init(&ctx);
+   rng_seed(&rng, 21);
+
+   for (int k = 0; k < TEST_DIFF_PAIRS; ++k) {
+      // mostly short strings, some long enough to be split many times
+      const uint32_t max = (k % 10 == 0) ? TEST_DIFF_MAX_LEN : 40;
+      random_string(s1, 1 + rng_below(&rng, max), &rng);
+      random_string(s2, 1 + rng_below(&rng, max), &rng);
+
+      struct record ref = {0};
+      const int dist = lev_diff_mode(&ctx, &ref, s1, s2, DIFF_FULL);
+      if (dist < 0) {
+         TEST_FAIL("pair %d: DIFF_FULL failed", k);
+         diff_ctx_free(&ctx);
+         return -1;
+      }
+
+      for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); ++m) {
+         struct record r = {0};
+         const int d = lev_diff_mode(&ctx, &r, s1, s2, modes[m]);
+         if (d != dist) {
+            TEST_FAIL("pair %d, mode %d: distance %d, expected %d", k,
+                      (int)modes[m], d, dist);
+            diff_ctx_free(&ctx);
+            return -1;
+         }
+         if (compare_weights(r.weights, ref.weights, MAX_CHARSET_LEN,
+                             (size_t)k) != 0) {
+            diff_ctx_free(&ctx);
+            return -1;
+         }
+      }
+
+      const int d = lev_distance(&ctx, s1, s2);
+      if (d != dist) {
+         TEST_FAIL("pair %d: lev_distance() %d, expected %d", k, d, dist);
+         diff_ctx_free(&ctx);
+         return -1;
+      }
+   }
+
+   diff_ctx_free(&ctx);
+   TEST_SUCCESS();
+   return 0;
+}
+
+/**
+ * @brief Compare DIFF_FULL with one instruction set against the scalar
+ * matrix.
+ */
+static int diff_simd_pair(struct diff_ctx *ctx, const char *s1, const char *s2,
+                          enum cpu_isa isa, int k)
+{
+   struct record ref = {0};
+   struct record r = {0};
+
+   if (cpu_set_isa(CPU_SCALAR) != 0)
+      return -1;
+   const int dist = lev_diff_mode(ctx, &ref, s1, s2, DIFF_FULL);
+
+   if (cpu_set_isa(isa) != 0)
+      return -1;
+   const int d = lev_diff_mode(ctx, &r, s1, s2, DIFF_FULL);
+
+   if (dist < 0 || d != dist) {
+      TEST_FAIL("pair %d, isa %d: distance %d, expected %d", k, (int)isa, d,
+                dist);
+      return -1;
+   }
+   return compare_weights(r.weights, ref.weights, MAX_CHARSET_LEN, (size_t)k);
+}
+
+int test_diff_simd(void)
+{
+   static char s1[TEST_DIFF_SIMD_LEN + 1];
+   static char s2[TEST_DIFF_SIMD_LEN + 1];
+   const enum cpu_isa best = cpu_isa();
+   const enum cpu_isa all[] = {CPU_SSE2, CPU_AVX2};
+   struct diff_ctx ctx;
+   struct rng rng;
+   diff_ctx_init(&ctx);
+   rng_seed(&rng, 25);
+
+   int ret = 0;
+   for (int k = 0; k < TEST_DIFF_PAIRS && ret == 0; ++k) {
+      // every length up to a few vectors, and some much longer
+      const uint32_t max = (k % 50 == 0) ? TEST_DIFF_SIMD_LEN : 40;
+      random_string(s1, 1 + rng_below(&rng, max), &rng);
+      random_string(s2, 1 + rng_below(&rng, max), &rng);
+
+      for (size_t i = 0; i < sizeof(all) / sizeof(all[0]); i++) {
+         if (cpu_set_isa(all[i]) != 0)
+            continue; // not supported by this CPU
+         if (diff_simd_pair(&ctx, s1, s2, all[i], k) != 0) {
+            ret = -1;
+            break;
+         }
+      }
+   }
+
+   diff_ctx_free(&ctx);
+   if (cpu_set_isa(best) != 0) {
+      TEST_FAIL("cannot restore isa %d", (int)best);
+      return -1;
+   }
+
+   if (ret == 0)
+      TEST_SUCCESS();
+   return ret;
+}
+
 // end file test_diff.c
@@ -9,6 +9,9 @@
 #define TEST_DIFF_H
 
 int test_diff(void);
+int test_diff_ctx(void);
+int test_diff_modes(void);
+int test_diff_simd(void);
 
 #endif // TEST_DIFF_H
 
@@ -5,8 +5,11 @@
  * @author Jakob Kastelic
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include "debug.h"
 #include "gen.h"
+#include "rng.h"
 #include "str.h"
 #include <ctype.h>
 #include <math.h>
@@ -15,9 +18,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #define TEST_MAX_WORDS 1000
 #define TEST_EPS 0.25
+#define TEST_CORPUS_LEN 300000
+#define TEST_MARKOV_LEN 5000
 
 static const char *const charset_def =
     "kmuresnaptlwi.jz=foy,vg5/q92h38b?47c1d60x";
@@ -228,7 +234,7 @@ int test_gen_chars(void)
 
    // test with default charset and uniform weights
    if ((test_gen_create_weights(weights, charset_def) != 0) ||
-       (gen_chars(buf, GEN_MAX, 3, 6, NULL, NULL) != 0) ||
+       (gen_chars(buf, GEN_MAX, 3, 6, NULL, NULL, NULL) != 0) ||
        (test_gen_analyze(buf, weights, 3, 6) != 0)) {
       TEST_FAIL("test with default charset and uniform weights");
       return -1;
@@ -236,7 +242,7 @@ int test_gen_chars(void)
 
    // uniform weights, except favor '?' heavily
    weights[str_char_to_int('?')] = 50;
-   if ((gen_chars(buf, GEN_MAX, 4, 8, weights, NULL) != 0) ||
+   if ((gen_chars(buf, GEN_MAX, 4, 8, weights, NULL, NULL) != 0) ||
        (test_gen_analyze(buf, weights, 4, 8) != 0)) {
       TEST_FAIL("uniform weights, except favor '?' heavily");
       return -1;
@@ -244,12 +250,29 @@ int test_gen_chars(void)
 
    // test with custom charset and uniform weights
    if ((test_gen_create_weights(weights, "abcde") != 0) ||
-       (gen_chars(buf, GEN_MAX, 2, 4, NULL, "abcde") != 0) ||
+       (gen_chars(buf, GEN_MAX, 2, 4, NULL, "abcde", NULL) != 0) ||
        (test_gen_analyze(buf, weights, 2, 4) != 0)) {
       TEST_FAIL("test with custom charset and uniform weights");
       return -1;
    }
 
+   // one prepared sampler serves repeated calls
+   struct gen_sampler gs;
+   weights[str_char_to_int('c')] = 20;
+   if (gen_sampler_init(&gs, weights, "abcde") != 0) {
+      TEST_FAIL("gen_sampler_init failed");
+      return -1;
+   }
+   for (int k = 0; k < 3; k++) {
+      if ((gen_chars_sampler(buf, GEN_MAX, 1, 5, &gs, NULL) != 0) ||
+          (test_gen_analyze(buf, weights, 1, 5) != 0)) {
+         TEST_FAIL("reused sampler, round %d", k);
+         gen_sampler_free(&gs);
+         return -1;
+      }
+   }
+   gen_sampler_free(&gs);
+
    TEST_SUCCESS();
    return 0;
 }
@@ -299,7 +322,7 @@ int test_select_random_word(void)
    const int trials = 10000;
 
    for (int i = 0; i < trials; ++i) {
-      const char *word = select_random_word(entries, 3, total);
+      const char *word = select_random_word(entries, 3, total, NULL);
       if (strcmp(word, "zero") == 0)
          count_zero++;
       else if (strcmp(word, "one") == 0)
@@ -332,6 +355,57 @@ int test_select_random_word(void)
    return 0;
 }
 
+int test_word_sampler(void)
+{
+   struct WordEntry entries[3] = {{"zero", 0.0F}, {"one", 1.0F}, {"two", 2.0F}};
+   const int trials = 30000;
+   int count[3] = {0};
+   struct word_sampler ws;
+
+   // weighted
+   if (word_sampler_init(&ws, entries, 3, compute_total_weight(entries, 3))) {
+      TEST_FAIL("word_sampler_init failed");
+      return -1;
+   }
+   for (int i = 0; i < trials; ++i) {
+      size_t len = 0;
+      const char *word = word_sampler_pick(&ws, NULL, &len);
+      for (int k = 0; k < 3; k++)
+         count[k] += (word == entries[k].word && len == strlen(word));
+   }
+   word_sampler_free(&ws);
+
+   const float ratio = (float)count[2] / (float)count[1];
+   if (count[0] != 0 || count[0] + count[1] + count[2] != trials ||
+       ratio < 1.8F || ratio > 2.2F) {
+      TEST_FAIL("weighted counts %d, %d, %d", count[0], count[1], count[2]);
+      return -1;
+   }
+
+   // uniform, when there are no weights
+   if (word_sampler_init(&ws, entries, 3, 0.0F)) {
+      TEST_FAIL("word_sampler_init failed");
+      return -1;
+   }
+   count[0] = count[1] = count[2] = 0;
+   for (int i = 0; i < trials; ++i) {
+      const char *word = word_sampler_pick(&ws, NULL, NULL);
+      for (int k = 0; k < 3; k++)
+         count[k] += (word == entries[k].word);
+   }
+   word_sampler_free(&ws);
+
+   for (int k = 0; k < 3; k++) {
+      if (count[k] < trials / 4 || count[k] > trials / 2) {
+         TEST_FAIL("uniform count of '%s' is %d", entries[k].word, count[k]);
+         return -1;
+      }
+   }
+
+   TEST_SUCCESS();
+   return 0;
+}
+
 int test_write_words(const char *test_file)
 {
    struct WordEntry entries[3] = {
@@ -346,7 +420,7 @@ int test_write_words(const char *test_file)
       return -1;
    }
 
-   if (write_words(fp, entries, 3, nw, total_weight) != 0) {
+   if (write_words(fp, entries, 3, nw, total_weight, NULL) != 0) {
       TEST_FAIL("write_words returned failure");
       if (fclose(fp) != 0) {
          ERROR("failed to close file");
@@ -603,6 +677,171 @@ int test_parse_word_file(const char *test_file)
    return 0;
 }
 
+int test_word_dict(void)
+{
+   struct WordEntry entries[3] = {{"zero", 0.0F}, {"one", 1.0F}, {"two", 2.0F}};
+   struct word_dict wd;
+   if (word_dict_init(&wd, entries, 3) != 0) {
+      TEST_FAIL("word_dict_init failed");
+      return -1;
+   }
+
+   // copies of the words, packed back to back
+   int ret = 0;
+   for (int i = 0; i < 3 && ret == 0; i++) {
+      if (wd.words[i] == entries[i].word ||
+          strcmp(wd.words[i], entries[i].word) != 0 ||
+          wd.lens[i] != strlen(entries[i].word) ||
+          wd.weights[i] != entries[i].weight) {
+         TEST_FAIL("entry %d not copied", i);
+         ret = -1;
+      } else if (i > 0 && wd.words[i] != wd.words[i - 1] + wd.lens[i - 1] + 1) {
+         TEST_FAIL("entry %d not packed", i);
+         ret = -1;
+      }
+   }
+   if (ret == 0 && (wd.count != 3 || wd.total_weight != 3.0F)) {
+      TEST_FAIL("wrong count or total weight");
+      ret = -1;
+   }
+
+   // a sampler over the dictionary never picks the zero-weight word
+   struct word_sampler ws;
+   if (ret == 0 && word_sampler_init_dict(&ws, &wd) != 0) {
+      TEST_FAIL("word_sampler_init_dict failed");
+      ret = -1;
+   } else if (ret == 0) {
+      for (int i = 0; i < 1000 && ret == 0; i++) {
+         if (word_sampler_pick(&ws, NULL, NULL) == wd.words[0]) {
+            TEST_FAIL("picked a word of zero weight");
+            ret = -1;
+         }
+      }
+      word_sampler_free(&ws);
+   }
+
+   word_dict_free(&wd);
+   if (ret == 0)
+      TEST_SUCCESS();
+   return ret;
+}
+
+/**
+ * @brief Check that word i of a dictionary, which need not be terminated, is
+ * the given word.
+ */
+static int dict_word_is(const struct word_dict *wd, int i, const char *word)
+{
+   return wd->lens[i] == strlen(word) &&
+          memcmp(wd->words[i], word, wd->lens[i]) == 0;
+}
+
+int test_word_dict_load(const char *test_file)
+{
+   FILE *f = fopen(test_file, "w");
+   if (!f) {
+      TEST_FAIL("could not create test file");
+      return -1;
+   }
+
+   // CRLF line endings and no newline after the last word
+   if (fputs("apple 1.0\r\nbanana 2.0\ncherry 0.5", f) == EOF) {
+      ERROR("failed to write to file");
+      if (fclose(f) != 0)
+         ERROR("failed to close file");
+      return -1;
+   }
+   if (fclose(f) != 0) {
+      ERROR("failed to close file");
+      return -1;
+   }
+
+   struct word_dict wd;
+   int ret = 0;
+   if (word_dict_load(&wd, test_file, 0) != 3) {
+      TEST_FAIL("wrong count");
+      ret = -1;
+   } else {
+      if (!dict_word_is(&wd, 0, "apple") || !dict_word_is(&wd, 1, "banana") ||
+          !dict_word_is(&wd, 2, "cherry") || wd.weights[0] != 1.0F ||
+          wd.weights[1] != 2.0F || wd.weights[2] != 0.5F ||
+          wd.total_weight != 3.5F) {
+         TEST_FAIL("wrong word data");
+         ret = -1;
+      } else if (!wd.src.map || wd.words[0] != wd.src.map ||
+                 wd.words[2] >= wd.src.map + wd.src.size ||
+                 wd.words[0][wd.lens[0]] != ' ') {
+         // views into the file, which is left as it is
+         TEST_FAIL("words not in the mapped file");
+         ret = -1;
+      }
+      word_dict_free(&wd);
+   }
+
+   // line limit
+   if (ret == 0) {
+      if (word_dict_load(&wd, test_file, 2) != 2 || wd.count != 2) {
+         TEST_FAIL("line limit not respected");
+         ret = -1;
+      }
+      word_dict_free(&wd);
+   }
+
+   // a pipe cannot be mapped and is read as a stream
+   int fds[2];
+   if (ret == 0 && pipe(fds) == 0) {
+      char path[32];
+      snprintf(path, sizeof(path), "/dev/fd/%d", fds[0]);
+      const char text[] = "kiwi 3.0\nlime 1.0\n";
+      const int ok = write(fds[1], text, sizeof(text) - 1) ==
+                     (ssize_t)(sizeof(text) - 1);
+      if (close(fds[1]) != 0 || !ok || word_dict_load(&wd, path, 0) != 2 ||
+          !dict_word_is(&wd, 1, "lime") || wd.weights[0] != 3.0F) {
+         TEST_FAIL("could not read a pipe");
+         ret = -1;
+      }
+      word_dict_free(&wd);
+      if (close(fds[0]) != 0)
+         ERROR("failed to close pipe");
+   }
+
+   // too few lines, a line too long, and a file that does not exist
+   debug_set_silent(true);
+   if (ret == 0 && word_dict_load(&wd, test_file, 4) != -1) {
+      word_dict_free(&wd);
+      TEST_FAIL("accepted too few lines");
+      ret = -1;
+   }
+   f = fopen(test_file, "w");
+   if (!f || fprintf(f, "ok\n%0*d\n", MAX_WORD_LINE - 1, 0) < 0) {
+      TEST_FAIL("could not create test file");
+      ret = -1;
+   }
+   if (f && fclose(f) != 0) {
+      ERROR("failed to close file");
+      ret = -1;
+   }
+   if (ret == 0 && word_dict_load(&wd, test_file, 0) != -1) {
+      word_dict_free(&wd);
+      TEST_FAIL("accepted a line too long");
+      ret = -1;
+   }
+   if (remove(test_file) != 0) {
+      ERROR("failed to remove file '%s'", test_file);
+      ret = -1;
+   }
+   if (ret == 0 && word_dict_load(&wd, test_file, 0) != -1) {
+      word_dict_free(&wd);
+      TEST_FAIL("loaded a missing file");
+      ret = -1;
+   }
+   debug_set_silent(false);
+
+   if (ret == 0)
+      TEST_SUCCESS();
+   return ret;
+}
+
 int test_gen_words(const char *tf1, const char *tf2, const char *tf3)
 {
    char valid_word_file[MAX_FILENAME_LEN];
@@ -647,7 +886,7 @@ int test_gen_words(const char *tf1, const char *tf2, const char *tf3)
 
    // case 1: valid file, output to file (should succeed)
    int ret = -1;
-   ret = gen_words(temp_out_file, valid_word_file, TEST_MAX_WORDS, 3);
+   ret = gen_words(temp_out_file, valid_word_file, TEST_MAX_WORDS, 3, NULL);
    if (ret != 0) {
       TEST_FAIL("gen_words failed on valid file with file output");
       return -1;
@@ -676,7 +915,7 @@ int test_gen_words(const char *tf1, const char *tf2, const char *tf3)
    debug_set_silent(true);
 
    // case 2: non-existent word file (should fail)
-   ret = gen_words(NULL, nonexistent_file, 2, 2);
+   ret = gen_words(NULL, nonexistent_file, 2, 2, NULL);
    if (ret == 0) {
       debug_set_silent(false);
       TEST_FAIL("gen_words succeeded with nonexistent word file");
@@ -684,7 +923,7 @@ int test_gen_words(const char *tf1, const char *tf2, const char *tf3)
    }
 
    // case 3: nl > number of lines in file (should fail)
-   ret = gen_words(NULL, valid_word_file, 2, 10);
+   ret = gen_words(NULL, valid_word_file, 2, 10, NULL);
    if (ret == 0) {
       debug_set_silent(false);
       TEST_FAIL("gen_words succeeded with nl > lines in file");
@@ -704,4 +943,227 @@ int test_gen_words(const char *tf1, const char *tf2, const char *tf3)
    return 0;
 }
 
+/**
+ * @brief Generate a corpus with the given seed and thread count, and read it
+ * back into buf, which must hold TEST_CORPUS_LEN + 2 bytes.
+ */
+static int test_gen_corpus_read(char *buf, const char *tf, int threads,
+                                const float *weights)
+{
+   struct rng rng;
+   rng_seed(&rng, 2025);
+   if (gen_corpus(tf, TEST_CORPUS_LEN, 2, 7, weights, NULL, threads, &rng) !=
+       0) {
+      TEST_FAIL("gen_corpus failed with %d threads", threads);
+      return -1;
+   }
+
+   const int len = str_read_file(buf, tf, TEST_CORPUS_LEN + 2);
+   if (remove(tf) != 0) {
+      ERROR("failed to remove file '%s'", tf);
+      return -1;
+   }
+   if (len != TEST_CORPUS_LEN + 1 || buf[TEST_CORPUS_LEN] != '\n') {
+      TEST_FAIL("corpus has %d bytes, expected %d", len, TEST_CORPUS_LEN + 1);
+      return -1;
+   }
+   buf[TEST_CORPUS_LEN] = '\0';
+   return 0;
+}
+
+int test_gen_corpus(const char *test_file)
+{
+   float weights[MAX_CHARSET_LEN];
+   if (test_gen_create_weights(weights, charset_def) != 0)
+      return -1;
+   weights[str_char_to_int('k')] = 10;
+
+   char *one = malloc(TEST_CORPUS_LEN + 2);
+   char *many = malloc(TEST_CORPUS_LEN + 2);
+   if (!one || !many) {
+      free(one);
+      free(many);
+      TEST_FAIL("out of memory");
+      return -1;
+   }
+
+   int ret = 0;
+   if (test_gen_corpus_read(one, test_file, 1, weights) != 0 ||
+       test_gen_corpus_read(many, test_file, 5, weights) != 0) {
+      ret = -1;
+   } else if (strcmp(one, many) != 0) {
+      TEST_FAIL("corpus depends on the number of threads");
+      ret = -1;
+   } else {
+      // cut the last, possibly truncated, word before the analysis
+      *strrchr(one, ' ') = '\0';
+      if (test_gen_analyze(one, weights, 2, 7) != 0) {
+         TEST_FAIL("corpus statistics");
+         ret = -1;
+      }
+   }
+
+   free(one);
+   free(many);
+   if (ret == 0)
+      TEST_SUCCESS();
+   return ret;
+}
+
+struct test_gen_sink {
+   size_t total;     // characters received
+   size_t max_chunk; // longest chunk
+   int chunks;       // number of chunks
+   int abort_after;  // fail once this many chunks were received
+};
+
+static int test_gen_count(void *ctx, const char *buf, size_t len)
+{
+   struct test_gen_sink *c = (struct test_gen_sink *)ctx;
+   for (size_t i = 0; i < len; i++) {
+      if (buf[i] == '\0')
+         return -1;
+   }
+   c->total += len;
+   c->chunks++;
+   if (len > c->max_chunk)
+      c->max_chunk = len;
+   return (c->chunks == c->abort_after) ? -1 : 0;
+}
+
+int test_gen_stream(void)
+{
+   const size_t len = 1000003;
+   struct test_gen_sink c = {0};
+
+   if (gen_stream(test_gen_count, &c, len, 3, 9, NULL, NULL, 1, NULL) != 0) {
+      TEST_FAIL("gen_stream failed");
+      return -1;
+   }
+   if (c.total != len || c.chunks < 10 || c.max_chunk > 65536 + 10) {
+      TEST_FAIL("%zu characters in %d chunks of up to %zu", c.total, c.chunks,
+                c.max_chunk);
+      return -1;
+   }
+
+   // a short session is a single chunk, whatever the number of threads
+   struct test_gen_sink one = {0};
+   if (gen_stream(test_gen_count, &one, 300, 3, 9, NULL, NULL, 4, NULL) != 0 ||
+       one.total != 300 || one.chunks != 1) {
+      TEST_FAIL("%zu characters in %d chunks", one.total, one.chunks);
+      return -1;
+   }
+
+   // an error from the sink stops the generation
+   struct test_gen_sink stop = {.abort_after = 2};
+   debug_set_silent(true);
+   const int ret = gen_stream(test_gen_count, &stop, len, 3, 9, NULL, NULL, 2,
+                              NULL);
+   debug_set_silent(false);
+   if (ret != -1 || stop.chunks != 2) {
+      TEST_FAIL("sink error ignored");
+      return -1;
+   }
+
+   TEST_SUCCESS();
+   return 0;
+}
+
+/**
+ * @brief Check that text from markov_gen() is made of words of the given
+ * lengths (except the last, which may be cut short), using only characters
+ * not excluded by the model.
+ */
+static int check_markov_text(const char *s, int min_word, int max_word,
+                             char banned)
+{
+   const size_t n = strlen(s);
+   if (n != TEST_MARKOV_LEN - 1 && n + 2 < TEST_MARKOV_LEN - 1) {
+      TEST_FAIL("wrong length %zu", n);
+      return -1;
+   }
+
+   for (const char *p = s; *p;) {
+      const size_t len = strcspn(p, " ");
+      const bool last = (p[len] == '\0');
+      if ((!last && (int)len < min_word) || (int)len > max_word) {
+         TEST_FAIL("word of length %zu", len);
+         return -1;
+      }
+      for (size_t i = 0; i < len; i++) {
+         if (str_char_to_int(p[i]) < 0 || p[i] == banned) {
+            TEST_FAIL("unexpected character '%c'", p[i]);
+            return -1;
+         }
+      }
+      p += last ? len : len + 1;
+   }
+   return 0;
+}
+
+int test_markov(void)
+{
+   static char s[TEST_MARKOV_LEN];
+   struct WordEntry one[1] = {{"abc", 0.0F}};
+   struct word_dict wd;
+   struct markov m;
+   struct rng rng;
+   rng_seed(&rng, 7);
+
+   if (word_dict_init(&wd, one, 1) != 0) {
+      TEST_FAIL("word_dict_init failed");
+      return -1;
+   }
+
+   // a single training word is all the chain can produce, at any order
+   for (int order = 1; order <= MARKOV_MAX_ORDER; order++) {
+      if (markov_train(&m, order, &wd, NULL) != 0) {
+         TEST_FAIL("markov_train failed at order %d", order);
+         word_dict_free(&wd);
+         return -1;
+      }
+      const int ret = markov_gen(&m, s, TEST_MARKOV_LEN, 1, 10, &rng);
+      markov_free(&m);
+      if (ret != 0 || strncmp(s, "abc abc abc ", 12) != 0 ||
+          check_markov_text(s, 3, 3, '\0') != 0) {
+         TEST_FAIL("order %d produced '%.20s'", order, s);
+         word_dict_free(&wd);
+         return -1;
+      }
+   }
+   word_dict_free(&wd);
+
+   // free text, with a character weighted out of the model
+   const char *text = "The quick brown fox jumps over the lazy dog; "
+                      "pack my box with five dozen liquor jugs.";
+   float weights[MAX_CHARSET_LEN];
+   for (int i = 0; i < MAX_CHARSET_LEN; i++)
+      weights[i] = 1.0F;
+   weights[str_char_to_int('e')] = 0.0F;
+
+   for (int order = 1; order <= MARKOV_MAX_ORDER; order++) {
+      if (markov_train_text(&m, order, text, weights) != 0) {
+         TEST_FAIL("markov_train_text failed at order %d", order);
+         return -1;
+      }
+      const int ret = markov_gen(&m, s, TEST_MARKOV_LEN, 2, 6, &rng);
+      markov_free(&m);
+      if (ret != 0 || check_markov_text(s, 2, 6, 'e') != 0)
+         return -1;
+   }
+
+   // invalid orders
+   debug_set_silent(true);
+   const int bad = markov_train_text(&m, 0, text, NULL) == 0 ||
+                   markov_train_text(&m, MARKOV_MAX_ORDER + 1, text, NULL) == 0;
+   debug_set_silent(false);
+   if (bad) {
+      TEST_FAIL("accepted an invalid order");
+      return -1;
+   }
+
+   TEST_SUCCESS();
+   return 0;
+}
+
 // end file test_gen.c
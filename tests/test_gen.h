@@ -13,12 +13,18 @@ int test_gen_clean_charset(void);
 int test_free_entries(void);
 int test_compute_total_weight(void);
 int test_select_random_word(void);
+int test_word_sampler(void);
 int test_write_words(const char *test_file);
 int test_is_line_too_long(const char *test_file);
 int test_validate_word(void);
 int test_parse_line(void);
 int test_parse_word_file(const char *test_file);
+int test_word_dict(void);
+int test_word_dict_load(const char *test_file);
 int test_gen_words(const char *tf1, const char *tf2, const char *tf3);
+int test_gen_corpus(const char *test_file);
+int test_gen_stream(void);
+int test_markov(void);
 
 #endif // TEST_GEN_H
 
@@ -0,0 +1,144 @@
+/**
+ * @file test_ring.c
+ * @brief Test the lock-free ring buffer.
+ *
+ * @author Jakob Kastelic
+ */
+
+#include "debug.h"
+#include "ring.h"
+#include <pthread.h>
+#include <stddef.h>
+
+#define TEST_RING_SIZE 1000
+#define TEST_RING_TOTAL 1000000
+#define TEST_RING_BLOCK 77
+
+int test_ring_wrap(void)
+{
+   struct ring r;
+   if (ring_init(&r, TEST_RING_SIZE) != 0) {
+      TEST_FAIL("ring_init failed");
+      return -1;
+   }
+
+   if (r.size != 1024 || ring_writable(&r) != 1024) {
+      TEST_FAIL("capacity %zu, expected 1024", r.size);
+      ring_free(&r);
+      return -1;
+   }
+
+   // push the counters around the end of the storage several times
+   float in[TEST_RING_BLOCK * 10];
+   float out[TEST_RING_BLOCK * 10];
+   float next_in = 0.0F;
+   float next_out = 0.0F;
+
+   for (int round = 0; round < 100; round++) {
+      const size_t n = (size_t)(((round * 37) % 700) + 1);
+      for (size_t i = 0; i < n; i++)
+         in[i] = next_in++;
+
+      if (ring_write(&r, in, n) != n || ring_readable(&r) != n) {
+         TEST_FAIL("round %d: short write", round);
+         ring_free(&r);
+         return -1;
+      }
+
+      if (ring_read(&r, out, n + 5) != n) {
+         TEST_FAIL("round %d: read more than written", round);
+         ring_free(&r);
+         return -1;
+      }
+
+      for (size_t i = 0; i < n; i++) {
+         if (out[i] != next_out++) {
+            TEST_FAIL("round %d: sample %zu out of order", round, i);
+            ring_free(&r);
+            return -1;
+         }
+      }
+   }
+
+   // a full buffer accepts no more samples
+   size_t total = 0;
+   while (total < 2000) {
+      const size_t n = ring_write(&r, in, TEST_RING_BLOCK);
+      if (n == 0)
+         break;
+      total += n;
+   }
+   ring_free(&r);
+
+   if (total != 1024) {
+      TEST_FAIL("full buffer holds %zu samples, expected 1024", total);
+      return -1;
+   }
+
+   TEST_SUCCESS();
+   return 0;
+}
+
+static void *test_ring_producer(void *arg)
+{
+   struct ring *r = (struct ring *)arg;
+   float block[TEST_RING_BLOCK];
+   size_t sent = 0;
+
+   while (sent < TEST_RING_TOTAL) {
+      size_t n = TEST_RING_TOTAL - sent;
+      if (n > TEST_RING_BLOCK)
+         n = TEST_RING_BLOCK;
+      for (size_t i = 0; i < n; i++)
+         block[i] = (float)((sent + i) % 65536);
+
+      size_t done = 0;
+      while (done < n)
+         done += ring_write(r, block + done, n - done);
+      sent += n;
+   }
+
+   return NULL;
+}
+
+int test_ring_threads(void)
+{
+   struct ring r;
+   if (ring_init(&r, 256) != 0) {
+      TEST_FAIL("ring_init failed");
+      return -1;
+   }
+
+   pthread_t producer;
+   if (pthread_create(&producer, NULL, test_ring_producer, &r) != 0) {
+      TEST_FAIL("cannot start producer thread");
+      ring_free(&r);
+      return -1;
+   }
+
+   int ret = 0;
+   float block[TEST_RING_BLOCK];
+   size_t got = 0;
+   while (got < TEST_RING_TOTAL) {
+      const size_t n = ring_read(&r, block, TEST_RING_BLOCK);
+      for (size_t i = 0; i < n && ret == 0; i++) {
+         if (block[i] != (float)((got + i) % 65536)) {
+            TEST_FAIL("sample %zu out of order", got + i);
+            ret = -1;
+         }
+      }
+      got += n;
+   }
+
+   if (pthread_join(producer, NULL) != 0) {
+      TEST_FAIL("cannot join producer thread");
+      ret = -1;
+   }
+   ring_free(&r);
+
+   if (ret == 0)
+      TEST_SUCCESS();
+   return ret;
+}
+
+// end file test_ring.c
@@ -0,0 +1,16 @@
+/**
+ * @file test_ring.h
+ * @brief Test the lock-free ring buffer.
+ *
+ * @author Jakob Kastelic
+ */
+
+#ifndef TEST_RING_H
+#define TEST_RING_H
+
+int test_ring_wrap(void);
+int test_ring_threads(void);
+
+#endif // TEST_RING_H
+
+// end file test_ring.h
@@ -0,0 +1,185 @@
+/**
+ * @file test_rng.c
+ * @brief Test the xoshiro128** generator.
+ *
+ * @author Jakob Kastelic
+ */
+
+#include "cpu.h"
+#include "debug.h"
+#include "gen.h"
+#include "rng.h"
+#include <stdint.h>
+#include <string.h>
+
+#define TEST_RNG_LEN 1000
+#define TEST_RNG_BULK 1003
+
+int test_rng_next(void)
+{
+   // reference output of xoshiro128** from the state {1, 2, 3, 4}
+   static const uint32_t ref[] = {0x2d00, 0x0, 0x5a7080, 0x4389d80};
+   struct rng r = {{1, 2, 3, 4}};
+   for (int i = 0; i < 4; i++) {
+      const uint32_t x = rng_next(&r);
+      if (x != ref[i]) {
+         TEST_FAIL("output %d is 0x%x, expected 0x%x", i, (unsigned)x,
+                   (unsigned)ref[i]);
+         return -1;
+      }
+   }
+
+   // range of the derived values
+   rng_seed(&r, 0);
+   for (int i = 0; i < TEST_RNG_LEN; i++) {
+      const float f = rng_float(&r);
+      const uint32_t k = rng_below(&r, 7);
+      if (f < 0.0F || f >= 1.0F || k >= 7) {
+         TEST_FAIL("value out of range: %f, %u", f, (unsigned)k);
+         return -1;
+      }
+   }
+
+   TEST_SUCCESS();
+   return 0;
+}
+
+int test_rng_streams(void)
+{
+   struct rng a;
+   struct rng b;
+   struct rng c;
+
+   // the same seed gives the same sequence, a different one does not
+   rng_seed(&a, 42);
+   rng_seed(&b, 42);
+   rng_seed(&c, 43);
+   int same = 0;
+   for (int i = 0; i < TEST_RNG_LEN; i++) {
+      const uint32_t x = rng_next(&a);
+      if (x != rng_next(&b)) {
+         TEST_FAIL("equal seeds diverge at %d", i);
+         return -1;
+      }
+      same += (x == rng_next(&c));
+   }
+   if (same > 2) {
+      TEST_FAIL("different seeds agree %d times", same);
+      return -1;
+   }
+
+   // split streams: the child continues where the parent was, and the
+   // parent jumps away from it
+   rng_seed(&a, 7);
+   b = a;
+   rng_split(&a, &c);
+   if (memcmp(&b, &c, sizeof(b)) != 0) {
+      TEST_FAIL("child does not take over the parent stream");
+      return -1;
+   }
+   rng_jump(&b);
+   if (memcmp(&a, &b, sizeof(a)) != 0) {
+      TEST_FAIL("parent not advanced by a jump");
+      return -1;
+   }
+   same = 0;
+   for (int i = 0; i < TEST_RNG_LEN; i++)
+      same += (rng_next(&a) == rng_next(&c));
+   if (same > 2) {
+      TEST_FAIL("split streams agree %d times", same);
+      return -1;
+   }
+
+   // generated text is reproducible from the seed
+   char s1[TEST_RNG_LEN];
+   char s2[TEST_RNG_LEN];
+   rng_seed(&a, 1234);
+   rng_seed(&b, 1234);
+   if (gen_chars(s1, sizeof(s1), 2, 6, NULL, NULL, &a) != 0 ||
+       gen_chars(s2, sizeof(s2), 2, 6, NULL, NULL, &b) != 0 ||
+       strcmp(s1, s2) != 0) {
+      TEST_FAIL("same seed gives different text");
+      return -1;
+   }
+
+   TEST_SUCCESS();
+   return 0;
+}
+
+static int test_rng_bulk_isa(enum cpu_isa isa)
+{
+   static uint32_t ref[TEST_RNG_BULK + RNG_LANES];
+   static uint32_t u[TEST_RNG_BULK];
+   static uint32_t k[TEST_RNG_BULK];
+   static float f[TEST_RNG_BULK];
+   struct rng r;
+   struct rng_lanes l;
+
+   // reference: lane j yields every RNG_LANES-th value, starting at j
+   rng_seed(&r, 99);
+   for (int j = 0; j < RNG_LANES; j++) {
+      struct rng lane;
+      rng_split(&r, &lane);
+      for (int i = j; i < TEST_RNG_BULK + RNG_LANES; i += RNG_LANES)
+         ref[i] = rng_next(&lane);
+   }
+
+   rng_seed(&r, 99);
+   rng_lanes_init(&l, &r);
+   rng_fill_u32(&l, u, TEST_RNG_BULK);
+   rng_seed(&r, 99);
+   rng_lanes_init(&l, &r);
+   rng_fill_float(&l, f, TEST_RNG_BULK);
+   rng_seed(&r, 99);
+   rng_lanes_init(&l, &r);
+   rng_fill_below(&l, k, TEST_RNG_BULK, 41);
+
+   for (int i = 0; i < TEST_RNG_BULK; i++) {
+      const float want_f = (float)(ref[i] >> 8U) * (1.0F / 16777216.0F);
+      const uint32_t want_k = (uint32_t)(((uint64_t)ref[i] * 41U) >> 32U);
+      if (u[i] != ref[i] || f[i] != want_f || k[i] != want_k) {
+         TEST_FAIL("isa %d: value %d differs", (int)isa, i);
+         return -1;
+      }
+   }
+
+   // the excess of the partial step is dropped, not carried over
+   rng_fill_u32(&l, u, RNG_LANES);
+   rng_seed(&r, 99);
+   rng_lanes_init(&l, &r);
+   rng_fill_u32(&l, k, TEST_RNG_BULK);
+   rng_fill_u32(&l, k, RNG_LANES);
+   if (memcmp(u, k, sizeof(uint32_t) * RNG_LANES) != 0) {
+      TEST_FAIL("isa %d: lanes out of step after a partial fill", (int)isa);
+      return -1;
+   }
+
+   return 0;
+}
+
+int test_rng_bulk(void)
+{
+   const enum cpu_isa best = cpu_isa();
+   const enum cpu_isa all[] = {CPU_SCALAR, CPU_SSE2, CPU_AVX2};
+
+   int ret = 0;
+   for (size_t i = 0; i < sizeof(all) / sizeof(all[0]); i++) {
+      if (cpu_set_isa(all[i]) != 0)
+         continue; // not supported by this CPU
+      if (test_rng_bulk_isa(all[i]) != 0) {
+         ret = -1;
+         break;
+      }
+   }
+
+   if (cpu_set_isa(best) != 0) {
+      TEST_FAIL("cannot restore isa %d", (int)best);
+      return -1;
+   }
+
+   if (ret == 0)
+      TEST_SUCCESS();
+   return ret;
+}
+
+// end file test_rng.c
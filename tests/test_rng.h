@@ -0,0 +1,17 @@
+/**
+ * @file test_rng.h
+ * @brief Test the xoshiro128** generator.
+ *
+ * @author Jakob Kastelic
+ */
+
+#ifndef TEST_RNG_H
+#define TEST_RNG_H
+
+int test_rng_next(void);
+int test_rng_streams(void);
+int test_rng_bulk(void);
+
+#endif // TEST_RNG_H
+
+// end file test_rng.h
@@ -0,0 +1,79 @@
+/**
+ * @file test_span.c
+ * @brief Test the vectorized span kernels.
+ *
+ * @author Jakob Kastelic
+ */
+
+#include "cpu.h"
+#include "debug.h"
+#include "span.h"
+#include <stddef.h>
+
+#define TEST_SPAN_LEN 77
+
+static int test_span_isa(enum cpu_isa isa)
+{
+   float src[TEST_SPAN_LEN + 1];
+   float dst[TEST_SPAN_LEN + 1];
+
+   for (int i = 0; i <= TEST_SPAN_LEN; i++)
+      src[i] = (float)(i * 3) - 0.25F;
+
+   // every length, at an unaligned offset
+   for (size_t n = 0; n <= TEST_SPAN_LEN; n++) {
+      for (size_t i = 0; i <= TEST_SPAN_LEN; i++)
+         dst[i] = -1.0F;
+
+      span_copy(dst + 1, src + 1, n);
+      span_add(dst + 1, src + 1, n);
+      for (size_t i = 1; i <= n; i++) {
+         if (dst[i] != 2.0F * src[i]) {
+            TEST_FAIL("isa %d, n = %zu: wrong sum at %zu", (int)isa, n, i);
+            return -1;
+         }
+      }
+
+      span_zero(dst + 1, n);
+      for (size_t i = 1; i <= n; i++) {
+         if (dst[i] != 0.0F) {
+            TEST_FAIL("isa %d, n = %zu: not cleared at %zu", (int)isa, n, i);
+            return -1;
+         }
+      }
+
+      if (dst[0] != -1.0F || (n < TEST_SPAN_LEN && dst[n + 1] != -1.0F)) {
+         TEST_FAIL("isa %d, n = %zu: wrote outside the span", (int)isa, n);
+         return -1;
+      }
+   }
+
+   return 0;
+}
+
+int test_span_kernels(void)
+{
+   const enum cpu_isa best = cpu_isa();
+   const enum cpu_isa all[] = {CPU_SCALAR, CPU_SSE2, CPU_AVX2};
+
+   int ret = 0;
+   for (size_t k = 0; k < sizeof(all) / sizeof(all[0]); k++) {
+      if (cpu_set_isa(all[k]) != 0)
+         continue; // not supported by this CPU
+      if (test_span_isa(all[k]) != 0) {
+         ret = -1;
+         break;
+      }
+   }
+
+   if (cpu_set_isa(best) != 0) {
+      TEST_FAIL("cannot restore isa %d", (int)best);
+      return -1;
+   }
+
+   if (ret == 0)
+      TEST_SUCCESS();
+   return ret;
+}
+
+// end file test_span.c
@@ -0,0 +1,15 @@
+/**
+ * @file test_span.h
+ * @brief Test the vectorized span kernels.
+ *
+ * @author Jakob Kastelic
+ */
+
+#ifndef TEST_SPAN_H
+#define TEST_SPAN_H
+
+int test_span_kernels(void);
+
+#endif // TEST_SPAN_H
+
+// end file test_span.h